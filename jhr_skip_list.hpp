@@ -58,72 +58,650 @@
 // include it from a C++ file and define JHR_SKIP_LIST_IMPLEMENTATION first.
 // (see USAGE)
 //
+// Requirements
+// ------------
+// The whole file requires C++17 (`std::optional`, `std::shared_mutex` and
+// `if constexpr` are used by the core list as well as by the wrappers).
+//
 // Supported Types
 // ---------------
 // Template types are used throughout the file.
 // This type needs to have both < and == operators.
 //
+// Link Policies
+// -------------
+// `Skip_List<T, Links>` takes a policy choosing what the links of its nodes
+// hold, and so the size of a tower of height h.
+//
+//  | Policy         | Link                                                   |
+//  | ranked         | Pointer and width, 16 bytes (the default)              |
+//  | compact_rank   | 32 bit node number and width, 8 bytes, < 2^32 elements |
+//  | no_rank        | Pointer only, 8 bytes, no index based functions        |
+//  | augment<M>     | Pointer, width and aggregate under the monoid M        |
+//  | back_linked    | Pointer, width and pointer back, 24 bytes              |
+//
+// A monoid M has a `value_type`, `static value_type identity()`,
+// `static value_type lift(T const&)` and an associative
+// `static value_type combine(value_type, value_type)`. Every link holds the
+// aggregate of the elements it skips, kept up to date by every modification,
+// and `aggregate(low, high)` combines the elements of [low, high) in
+// O(log n):
+//
+//    struct Total_Size {
+//      using value_type = uint64_t;
+//      static uint64_t identity() { return 0; }
+//      static uint64_t lift(Order const& order) { return order.size; }
+//      static uint64_t combine(uint64_t a, uint64_t b) { return a + b; }
+//    };
+//    jhr::Skip_List<Order, jhr::augment<Total_Size>> book;
+//    uint64_t depth = book.aggregate(Order{100}, Order{110});
+//
+// Back links make the iterators bidirectional: `--end()`, `std::prev()` and
+// `rbegin()`/`rend()` walk the list backwards, and `erase()` or `extract()`
+// at an iterator find the predecessors of the node without comparing any
+// element.
+//
 // Skip List Methods
 // -----------------
 //  | Function        | Effect                                                |
 //  |             Creation and deletion                                       |
 //  | (constructor) | Create a skip list TODO COPY                            |
 //  | (desctructor) | Destroy a skip list                                     |
+//  | build()       | Replaces the content with a sorted range, in parallel  |
+//  | clear()       | Removes every element                                   |
+//  | compact()     | Moves the nodes into contiguous memory, in order        |
+//  | set_huge_pages() | Carves new nodes out of 2 MiB huge pages             |
 //  |             Size and capacity                                           |
 //  | length()      | Returns the number of elements in skip list             |
 //  | MaxLevel()    | Calculates the optimal maximum for the amount of levels |
 //  |             Element access                                              |
-//  | [], at()      | Accesses the element at a particular index              |
+//  | [], at()      | Accesses the element at a particular index, or at      |
+//  |               | several sorted indices along one search path            |
+//  | peek_min()    | Returns the smallest element in O(1)                    |
 //  |             Modification                                                |
 //  | insert()      | Inserts an element in the skip list                     |
+//  | insert_bulk() | Sorts and merges an unsorted range, in parallel         |
+//  | emplace()     | Builds an element in place, returns an iterator to it   |
 //  | remove()      | Removes an element from the skip list and deletes it    |
+//  | remove_at()   | Removes the element at a particular index               |
+//  | pop_min()     | Unlinks the first node from the head, no search         |
+//  | pop_max()     | Removes the largest element, no comparison              |
+//  | erase()       | Removes every element of a key range in O(log n + k)    |
+//  | erase_at()    | Removes every element of an index range                 |
+//  | erase(it)     | Removes the element at an iterator                      |
+//  | extract()     | Unlinks an element into a handle for `insert()`         |
+//  | split_at()    | Moves the elements from a key on to a new list          |
+//  | split_at_index() | Moves the elements from an index on to a new list    |
+//  | concat()      | Appends a list of greater elements in O(log n)          |
+//  | merge()       | Moves the elements of another list in, in O(n + m)      |
+//  |             Set operations                                              |
+//  | set_union()   | Returns the elements of either list                     |
+//  | set_intersection() | Returns the elements of both lists                 |
+//  | set_difference() | Returns the elements missing from another list       |
 //  |             Searching                                                   |
 //  | find()        | Finds the node associated to a pointer in the skip list |
+//  | lower_bound() | Returns an iterator to the first element not smaller    |
+//  | aggregate()   | Combines a key range, for `augment` links               |
+//  | freeze()      | Returns a read-only copy laid out for searching         |
+//  |             Parallel algorithms                                         |
+//  | parallel_for_each() | Calls a function on every element of a range      |
+//  | parallel_reduce()   | Folds the elements of a range into a single value |
+//  |             Persistence                                                 |
+//  | save()        | Writes a checksummed snapshot of the list               |
+//  | load()        | Rebuilds the list from a snapshot in one linear pass    |
 //  |             Visualization                                               |
 //  | DisplayList() | Prints a visual representation of the skip list         |
+//
+// Frozen Skip List
+// ----------------
+// `freeze()` copies the list into a `Frozen_Skip_List`, an immutable pair of
+// flat arrays for long read-only phases: the elements in order, and the
+// elements in Eytzinger order, searched without branching on comparisons.
+// `at()` becomes O(1). `thaw()` builds a `Skip_List` back in linear time.
+//
+// Skip Multiset
+// -------------
+// `Skip_Multiset<T, Links>` keeps every inserted element: equal elements are
+// linked one after the other in insertion order, `find()` returning the
+// first one.
+//
+//  | Function      | Effect                                                  |
+//  | insert()      | Inserts an element after the elements equal to it       |
+//  | emplace()     | Inserts an element built in place                       |
+//  | count()       | Counts the elements equal to a value in O(log n)        |
+//  | equal_range() | Returns the elements equal to a value, in order         |
+//  | erase()       | Removes one or all elements equal to a value            |
+//  | pop_min(), remove_at() | Remove the first element, or one by index      |
+//  | lower_bound(), upper_bound(), find(), at() | Search the multiset        |
+//
+// Sliding Window
+// --------------
+// `Sliding_Window<T, Links>` keeps the last samples of a stream in a
+// `Skip_Multiset` and evicts them in arrival order, for rolling medians and
+// percentiles.
+//
+//  | Function      | Effect                                                  |
+//  | push()        | Adds a sample, evicting the oldest one if full          |
+//  | quantile()    | Returns a quantile of the samples in O(log n)           |
+//  | quantiles()   | Returns several quantiles along one search path         |
+//
+// Expiring Skip List
+// ------------------
+// `Expiring_Skip_List<T, Clock>` gives every element a deadline, kept in a
+// companion list ordered by deadline, and removes expired elements a bounded
+// number at a time.
+//
+//  | Function      | Effect                                                  |
+//  | insert()      | Inserts or refreshes an element with its deadline       |
+//  | find()        | Returns an element that has not expired yet             |
+//  | remove()      | Removes an element and its deadline                     |
+//  | sweep()       | Removes up to a budget of expired elements              |
+//  | next_deadline() | Returns the earliest deadline                         |
+//
+// Interval Skip List
+// ------------------
+// `Interval_Skip_List<T>` indexes closed intervals [low, high] by their
+// endpoints, with Hanson's markers on the links of the towers, and answers
+// stabbing and overlap queries in O(log n + k).
+//
+//  | Function      | Effect                                                  |
+//  | insert()      | Inserts an interval, equal intervals are kept           |
+//  | remove()      | Removes one interval equal to [low, high]               |
+//  | stab()        | Returns the intervals containing a point                |
+//  | overlap()     | Returns the intervals overlapping [low, high]           |
+//
+// Sharded Skip List
+// -----------------
+// `Sharded_Skip_List` splits the key space into ranges, each stored in its own
+// `Skip_List` behind its own lock, so that writers to different ranges scale
+// across cores.
+//
+//  | Function      | Effect                                                  |
+//  | length()      | Returns the number of elements in all the shards        |
+//  | at()          | Returns a copy of the element at a particular index     |
+//  | find()        | Returns a copy of the element equal to a value, if any  |
+//  | insert()      | Inserts an element in the shard owning its key          |
+//  | remove()      | Removes an element from the shard owning its key        |
+//  | Rebalance()   | Splits and merges shards that became skewed             |
+//  | shards()      | Returns the current number of shards                    |
+//
+// Concurrent Priority Queue
+// -------------------------
+// `Concurrent_Priority_Queue` spreads its elements over one locked skip list
+// per consumer thread.
+//
+//  | Function      | Effect                                                  |
+//  | length()      | Returns the number of elements in the queue             |
+//  | push()        | Pushes an element in a random lane                      |
+//  | pop_min()     | Removes the smallest element, locks every lane          |
+//  | pop_spray()   | Removes one of the O(p log^3 p) smallest elements       |
+//
+// Versioned Skip List
+// -------------------
+// `Versioned_Skip_List` keeps a chain of versions per element so that readers
+// can iterate a consistent `Snapshot` while a writer keeps going.
+//
+//  | Function      | Effect                                                  |
+//  | insert()      | Writes a new version of an element                      |
+//  | remove()      | Writes a removal of an element                          |
+//  | find()        | Returns a copy of the latest version of an element      |
+//  | snapshot()    | Takes a snapshot as of the last write                   |
+//  | collect()     | Drops the versions no live snapshot can see             |
+//  | Snapshot::begin(), end(), find(), at() | Read the list as of the snapshot |
+//
+// Mapped Skip List
+// ----------------
+// `Mapped_Skip_List` stores its nodes in a memory mapped file, with links
+// being offsets in the file and trivially copyable elements stored inline.
+// Opening a list is O(1), pages are read on demand, and several processes
+// can map the same file read-only. It requires POSIX.
+//
+//  | Function      | Effect                                                  |
+//  | (constructor) | Creates, opens or opens read-only the list of a file    |
+//  | length(), at(), find(), begin(), end() | Same as `Skip_List`            |
+//  | insert()      | Inserts or overwrites an element in place               |
+//  | remove()      | Removes an element, its node is reused later            |
+//  | flush()       | Writes the modified pages back to the file              |
+//
+// Durable Skip List
+// -----------------
+// `Durable_Skip_List` logs every write to a `Write_Ahead_Log` before applying
+// it. The log syncs batches of records on a background thread (group
+// commit). Opening the list loads its last snapshot and replays the log.
+// It requires POSIX.
+//
+//  | Function      | Effect                                                  |
+//  | (constructor) | Loads the last snapshot and replays the log over it     |
+//  | insert()      | Logs and inserts an element                             |
+//  | remove()      | Logs and removes an element                             |
+//  | length(), at(), find() | Same as `Skip_List`, returning copies          |
+//  | sync()        | Blocks until every write so far is durable              |
+//  | checkpoint()  | Saves a snapshot and empties the log                    |
+//
+// Memtable
+// --------
+// `Skip_Memtable` buffers writes in a skip list and tracks its approximate
+// memory usage. Past a threshold the list is frozen, a fresh one takes its
+// place and a background thread writes the frozen list to a `Sorted_Run`:
+// blocks of records followed by a sparse index of their first elements.
+// Inserting never waits for a flush.
+//
+//  | Function      | Effect                                                  |
+//  | insert()      | Inserts an element in the active list                   |
+//  | find()        | Searches the active then the frozen lists               |
+//  | freeze()      | Freezes the active list and schedules its flush         |
+//  | wait()        | Blocks until every frozen list is written               |
+//  | runs()        | Returns the paths of the runs written so far            |
+//  | usage()       | Returns the bytes used by the active list               |
+//
+// A `Sorted_Run` reads the index of a run and answers `find()` reading a
+// single block.
 // ============================================================================
 
+#if __cplusplus < 201703L && (!defined(_MSVC_LANG) || _MSVC_LANG < 201703L)
+#error "SKIP_LIST: jhr_skip_list.hpp requires C++17"
+#endif
+
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cerrno>
+#include <chrono>
 #include <cmath>  // for log
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <set>
+#include <shared_mutex>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Memory mapped skip lists need POSIX
+#if defined(__unix__) || defined(__APPLE__)
+#define JHR_SKIP_LIST_POSIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 namespace jhr {
-template <typename T>
+namespace internal {
+// Stream buffer computing a 64 bit FNV-1a checksum of the bytes going
+// through it. Written bytes are forwarded to `target` if there is one, read
+// bytes are read from `target` one request at a time, never ahead.
+class Checksum_Buffer : public std::streambuf {
+ private:
+  std::streambuf* target_;
+  uint64_t checksum_{14695981039346656037ULL};
+  char current_;
+
+  void Hash(char const* s, std::streamsize n) {
+    for (std::streamsize i = 0; i < n; i++) {
+      checksum_ ^= static_cast<unsigned char>(s[i]);
+      checksum_ *= 1099511628211ULL;
+    }
+  }
+
+ protected:
+  int_type overflow(int_type c) override {
+    if (traits_type::eq_int_type(c, traits_type::eof())) return c;
+    char ch{traits_type::to_char_type(c)};
+    return xsputn(&ch, 1) == 1 ? c : traits_type::eof();
+  }
+
+  std::streamsize xsputn(char const* s, std::streamsize n) override {
+    Hash(s, n);
+    return target_ ? target_->sputn(s, n) : n;
+  }
+
+  int_type underflow() override {
+    if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+    if (!target_ || target_->sgetn(&current_, 1) != 1)
+      return traits_type::eof();
+    Hash(&current_, 1);
+    setg(&current_, &current_, &current_ + 1);
+    return traits_type::to_int_type(current_);
+  }
+
+  std::streamsize xsgetn(char* s, std::streamsize n) override {
+    std::streamsize read{0};
+    if (gptr() < egptr() && n > 0) {
+      *s = *gptr();
+      gbump(1);
+      read = 1;
+    }
+    if (target_ && read < n) {
+      std::streamsize more{target_->sgetn(s + read, n - read)};
+      Hash(s + read, more);
+      read += more;
+    }
+    return read;
+  }
+
+ public:
+  explicit Checksum_Buffer(std::streambuf* target = nullptr)
+      : target_{target} {}
+
+  inline uint64_t checksum() const { return checksum_; }
+};
+
+// Writes the bytes of a trivially copyable value.
+template <typename U>
+inline void WritePod(std::ostream& out, U const& value) {
+  static_assert(std::is_trivially_copyable<U>::value,
+                "U must be trivially copyable");
+  out.write(reinterpret_cast<char const*>(&value), sizeof(U));
+}
+
+// Reads the bytes of a trivially copyable value.
+template <typename U>
+inline U ReadPod(std::istream& in) {
+  static_assert(std::is_trivially_copyable<U>::value,
+                "U must be trivially copyable");
+  U value;
+  in.read(reinterpret_cast<char*>(&value), sizeof(U));
+  return value;
+}
+
+// Hands out blocks of memory carved in order from chunks. Blocks given back
+// are kept in free lists, one per size, and handed out again first. Chunks
+// are only freed with the arena. An arena is not thread safe.
+//
+// No chunk is allocated before the first block. The first chunk fits the
+// first block exactly, and every new chunk doubles the size of the last one
+// up to 1 MiB, so that small lists stay small. Chunks smaller than that come
+// from the heap, 1 MiB chunks are mapped straight from the OS.
+//
+// With huge pages, chunks are whole 2 MiB pages: explicit huge pages when
+// the system has some reserved, transparent huge pages otherwise, falling
+// back on regular pages where neither is supported.
+//
+// Blocks can also be numbered on 32 bits by their chunk and their offset in
+// it, the first block of the arena being number 0.
+//
+// Chunks can be shared between arenas, see `share()`, they are freed with
+// the last arena holding them.
+class Node_Arena {
+ private:
+  struct Chunk {
+    void* data;
+    size_t size;
+    // Frees the chunk once no arena holds it anymore
+    std::shared_ptr<void> owner;
+  };
+
+  // Size chunks grow to, and above which they are mapped
+  static constexpr size_t kChunkSize_{size_t{1} << 20};
+  static constexpr size_t kHugePageSize_{size_t{1} << 21};
+  static constexpr size_t kAlignment_{alignof(std::max_align_t)};
+
+  // Bits of a block number holding its offset, the others hold its chunk
+  static constexpr uint32_t kOffsetBits_{17};
+  static constexpr size_t kMaxChunks_{size_t{1} << (32 - kOffsetBits_)};
+
+  bool huge_pages_;
+
+  // Whether numbers were handed out, limiting the number of chunks
+  bool numbered_{false};
+
+  std::vector<Chunk> chunks_;
+
+  // Unused end of the chunk numbered `current_`
+  unsigned char* next_{nullptr};
+  size_t left_{0};
+  size_t current_{0};
+
+  // Heads of the free lists, by size in units of `kAlignment_`. Every free
+  // block holds a pointer to the next free block of its size, then its
+  // number.
+  std::vector<void*> free_;
+
+  // Large chunks are mapped straight from the OS when possible, so that
+  // freeing them gives the memory back.
+  static void* AllocateChunk(size_t size, bool huge_pages);
+  static void FreeChunk(void* data, size_t size);
+
+  static size_t Units(size_t size) {
+    return (size + kAlignment_ - 1) / kAlignment_;
+  }
+
+  void Release();
+
+  // Takes over everything `other` holds, leaving it empty.
+  void Take(Node_Arena& other) noexcept;
+
+ public:
+  explicit Node_Arena(bool huge_pages = false) : huge_pages_{huge_pages} {}
+  Node_Arena(Node_Arena&& other) noexcept;
+  Node_Arena& operator=(Node_Arena&& other) noexcept;
+  Node_Arena(Node_Arena const&) = delete;
+  Node_Arena& operator=(Node_Arena const&) = delete;
+  ~Node_Arena() { Release(); }
+
+  // Returns a block of `size` bytes aligned for any type, and its number in
+  // `number` if it is not null. Throws an `std::overflow_error` if the arena
+  // is too large to number its blocks.
+  void* allocate(size_t size, uint32_t* number = nullptr);
+
+  // Returns the block numbered `number`.
+  inline void* block(uint32_t number) const {
+    return static_cast<unsigned char*>(chunks_[number >> kOffsetBits_].data) +
+           (number & ((uint32_t{1} << kOffsetBits_) - 1)) * kAlignment_;
+  }
+
+  // Returns the number of bytes of the chunks of the arena.
+  size_t capacity() const;
+
+  // Gives back a block of `size` bytes returned by `allocate()`, with its
+  // number if it had one.
+  void deallocate(void* block, size_t size, uint32_t number = 0);
+
+  // Returns `true` if new chunks are made of huge pages.
+  inline bool huge_pages() const { return huge_pages_; }
+
+  // Makes new chunks out of huge pages, or not.
+  inline void set_huge_pages(bool enable) { huge_pages_ = enable; }
+
+  // Returns an empty arena holding the chunks of this one too, numbered the
+  // same, so that blocks allocated by this arena can be given back to the
+  // new one. New blocks are carved out of new chunks.
+  Node_Arena share() const;
+
+  // Takes over the chunks and free blocks of `other`, leaving it empty.
+  // Chunks both arenas hold are kept once. Returns the new number of every
+  // chunk of `other`, see `renumber()`.
+  std::vector<uint32_t> splice(Node_Arena& other);
+
+  // Returns the number of a block of an arena given to `splice()`, from its
+  // number in that arena and the chunk numbers `splice()` returned.
+  static inline uint32_t renumber(uint32_t number,
+                                  std::vector<uint32_t> const& chunks) {
+    return chunks[number >> kOffsetBits_] << kOffsetBits_ |
+           (number & ((uint32_t{1} << kOffsetBits_) - 1));
+  }
+};
+}  // namespace internal
+
+// Link policies, the second template parameter of `Skip_List`, choose what
+// the links of the nodes hold.
+
+// Links hold a pointer to the next node and the number of nodes they skip,
+// the width, which gives `at()` and the index based functions in O(log n).
+struct ranked {};
+
+// Links hold the 32 bit number of the next node in the arena of the list and
+// a 32 bit width, half the size of `ranked` links. The list holds fewer than
+// 2^32 elements.
+struct compact_rank {};
+
+// Links hold a pointer to the next node only, for lists never accessed by
+// index: inserting and removing skip every width update. `at()`,
+// `remove_at()`, `erase_at()`, the parallel algorithms and `DisplayList()`
+// are unavailable.
+struct no_rank {};
+
+// Links hold a pointer, a width and the aggregate of the elements they skip,
+// which gives `aggregate()` in O(log n). `Monoid` provides a `value_type`,
+// trivially destructible, with an `identity()`, a `lift(T const&)` turning an
+// element into a value and an associative `combine(a, b)`.
+template <typename Monoid>
+struct augment {};
+
+// Links hold a pointer, a width and a pointer back to the previous node of
+// their level: iterators are bidirectional, and an element is removed at an
+// iterator in O(log n) without any comparison.
+struct back_linked {};
+
+namespace internal {
+// Links of `Interval_Skip_List` also hold the markers of the intervals
+// spanning them.
+template <typename Marker>
+struct marked {};
+
+// The monoid of `augment` links, void for the other policies
+template <typename Links>
+struct Link_Monoid {
+  using type = void;
+};
+template <typename Monoid>
+struct Link_Monoid<augment<Monoid>> {
+  using type = Monoid;
+};
+}  // namespace internal
+
+template <typename T, typename Links = ranked>
 class Skip_Node;
 
-template <typename T>
+template <typename T, typename Links>
 struct Skip_Link {
   size_t width{1};
-  Skip_Node<T>* node{nullptr};
+  Skip_Node<T, Links>* node{nullptr};
+};
+
+template <typename T>
+struct Skip_Link<T, no_rank> {
+  Skip_Node<T, no_rank>* node{nullptr};
+};
+
+template <typename T, typename Monoid>
+struct Skip_Link<T, augment<Monoid>> {
+  // The arena frees the links without destroying them
+  static_assert(
+      std::is_trivially_destructible<typename Monoid::value_type>::value,
+      "SKIP_LIST: aggregates must be trivially destructible");
+
+  size_t width{1};
+  Skip_Node<T, augment<Monoid>>* node{nullptr};
+  // Aggregate of the elements after the node up to `node`, identity for a
+  // null link
+  typename Monoid::value_type value{Monoid::identity()};
+};
+
+// The markers are allocated with the first one and freed by
+// `Interval_Skip_List`, the arena frees the links without destroying them.
+template <typename T, typename Marker>
+struct Skip_Link<T, internal::marked<Marker>> {
+  size_t width{1};
+  Skip_Node<T, internal::marked<Marker>>* node{nullptr};
+  std::vector<Marker>* markers{nullptr};
+};
+
+template <typename T>
+struct Skip_Link<T, back_linked> {
+  size_t width{1};
+  Skip_Node<T, back_linked>* node{nullptr};
+  // Previous node of the level, the last node of the level for the head
+  Skip_Node<T, back_linked>* prev{nullptr};
 };
 
-// A node for an item inside the skip list
 template <typename T>
+struct Skip_Link<T, compact_rank> {
+  uint32_t width{1};
+  // Number of the node in the arena, 0 (the head) for a null link
+  uint32_t node{0};
+};
+
+// A node for an item inside the skip list
+// The links of the node are stored right after it, in the same block of
+// memory, which must be `Size(level)` bytes long.
+template <typename T, typename Links>
 class Skip_Node {
  private:
-  size_t level_;
+  uint32_t level_;
 
  public:
+  // Number of the node in the arena of its list, for `compact_rank` links
+  uint32_t number_{0};
+
   T const* ptr_;
 
-  // Array of links to different nodes
-  std::unique_ptr<Skip_Link<T>[]> forward_;
+  // Array of links to different nodes, `level_` of them
+  Skip_Link<T, Links> forward_[1];
 
   Skip_Node(T const* ptr, size_t level)
-      : ptr_{ptr}, forward_{new Skip_Link<T>[level]}, level_{level} {
-    // Initialize the link array
-    for (size_t i = 0; i < level; i++) {
-      forward_[i] = Skip_Link<T>();
+      : level_{static_cast<uint32_t>(level)}, ptr_{ptr} {
+    // Initialize the rest of the link array
+    for (size_t i = 1; i < level; i++) {
+      new (&forward_[i]) Skip_Link<T, Links>();
     }
   }
+
+  // Returns the number of links of the node.
+  inline size_t level() const { return level_; }
+
+  // Returns the size of the block holding a node with `level` links.
+  static constexpr size_t Size(size_t level) {
+    return sizeof(Skip_Node) + (level - 1) * sizeof(Skip_Link<T, Links>);
+  }
 };
 
-// TODO description
 template <typename T>
+class Frozen_Skip_List;
+
+template <typename T, typename Links = ranked>
+class Skip_Multiset;
+
+template <typename T>
+class Interval_Skip_List;
+
+// TODO description
+template <typename T, typename Links = ranked>
 class Skip_List {
  private:
+  friend class Skip_Multiset<T, Links>;
+  template <typename U>
+  friend class Interval_Skip_List;
+
+  // `compact_rank` links hold node numbers rather than pointers
+  static constexpr bool kNumbered_{std::is_same<Links, compact_rank>::value};
+
+  // `no_rank` links hold no width
+  static constexpr bool kRanked_{!std::is_same<Links, no_rank>::value};
+
+  // The monoid of `augment` links, void for the other policies
+  using Monoid = typename internal::Link_Monoid<Links>::type;
+  static constexpr bool kAugmented_{!std::is_void<Monoid>::value};
+
+  // `back_linked` links also point to the previous node
+  static constexpr bool kBackLinked_{std::is_same<Links, back_linked>::value};
+
   // Maximum level for this skip list
   const size_t kMaxLevel_{16};
 
@@ -136,20 +714,313 @@ class Skip_List {
 
   size_t width_{0};
 
+  // Memory of the nodes of the list
+  internal::Node_Arena arena_;
+
   // Pointer to first node, this node does not contain any data
-  Skip_Node<T>* head_{new Skip_Node<T>(nullptr, kMaxLevel_)};
+  Skip_Node<T, Links>* head_{CreateNode(nullptr, kMaxLevel_)};
+
+  // Source of randomness for the node levels. Every list owns its own engine
+  // so that lists used from different threads never share state.
+  std::minstd_rand random_{};
+
+  // Inputs smaller than this are not worth splitting between threads.
+  static constexpr size_t kParallelGrain_{1 << 14};
+
+  // Returns the node `x` links to on level `i`, or a null pointer.
+  inline Skip_Node<T, Links>* Next(Skip_Node<T, Links> const* x,
+                                   size_t i) const {
+    if constexpr (kNumbered_) {
+      uint32_t number{x->forward_[i].node};
+      if (number == 0) return nullptr;
+      return static_cast<Skip_Node<T, Links>*>(arena_.block(number));
+    } else {
+      return x->forward_[i].node;
+    }
+  }
+
+  // Links `x` to `y` on level `i`. Back links are set on `y`, or on the head
+  // when `x` becomes the last node of the level.
+  inline void SetNext(Skip_Node<T, Links>* x, size_t i,
+                      Skip_Node<T, Links> const* y) {
+    if constexpr (kNumbered_)
+      x->forward_[i].node = y == nullptr ? 0 : y->number_;
+    else
+      x->forward_[i].node = const_cast<Skip_Node<T, Links>*>(y);
+
+    if constexpr (kBackLinked_)
+      (y ? const_cast<Skip_Node<T, Links>*>(y) : head_)->forward_[i].prev = x;
+  }
+
+  // Returns the node linking to `x` on level `i`, `back_linked` links only.
+  inline Skip_Node<T, Links>* Prev(Skip_Node<T, Links> const* x,
+                                   size_t i) const {
+    return x->forward_[i].prev;
+  }
+
+  // Returns the last node of level `i`, the head if it is empty,
+  // `back_linked` links only.
+  inline Skip_Node<T, Links>* Tail(size_t i) const {
+    return head_->forward_[i].prev ? head_->forward_[i].prev : head_;
+  }
+
+  // Returns the width of the link of `x` on level `i`.
+  inline size_t Width(Skip_Node<T, Links> const* x, size_t i) const {
+    return x->forward_[i].width;
+  }
+
+  // Sets the width of the link of `x` on level `i`, if links hold widths.
+  inline void SetWidth(Skip_Node<T, Links>* x, size_t i, size_t width) {
+    if constexpr (kRanked_)
+      x->forward_[i].width =
+          static_cast<decltype(x->forward_[i].width)>(width);
+  }
+
+  // Returns the aggregate of the link of `x` on level `i`.
+  inline auto const& Value(Skip_Node<T, Links> const* x, size_t i) const {
+    return x->forward_[i].value;
+  }
+
+  // Recomputes the aggregate of the link of `x` on level `i` from the links
+  // it spans on the level below.
+  void Augment(Skip_Node<T, Links>* x, size_t i);
+
+  // Recomputes the aggregates of the links of `update`, the predecessors of
+  // a changed node on its `levels` first levels, bottom up.
+  void AugmentPath(Skip_Node<T, Links>* const* update, size_t levels);
+
+  // Recomputes every aggregate of the list, level by level.
+  void AugmentAll();
+
+  // Throws an `std::overflow_error` if the links cannot count `length`
+  // elements.
+  static void CheckLength(size_t length) {
+    if (kNumbered_ && length > UINT32_MAX)
+      throw std::overflow_error("SKIP_LIST");
+  }
 
   // Returns a random level. This level is always smaller than `kMaxLevel_`.
-  size_t RandomLevel();
+  size_t RandomLevel() { return RandomLevel(random_); }
+  size_t RandomLevel(std::minstd_rand& random) const;
+
+  // Returns the number of chunks an input of `n` elements is split into.
+  static size_t Chunks(size_t n, size_t threads);
+
+  // Relinks every level of the list over `chunks`, the nodes of the list in
+  // order. Chunks are linked in parallel then stitched together.
+  void Link(std::vector<std::vector<Skip_Node<T, Links>*>> const& chunks);
+
+  // Calls `function(task)` for every task in [0, tasks) on its own thread.
+  template <typename Function>
+  static void RunParallel(size_t tasks, Function const& function);
+
+  // Calls `function(chunk, node, count)` on `chunks` slices of the index
+  // range [first, last) in parallel.
+  template <typename Function>
+  void ForEachChunk(size_t first, size_t last, size_t chunks,
+                    Function const& function) const;
+
+  // Returns the node at `index`, or a null pointer.
+  Skip_Node<T, Links>* NodeAt(size_t index) const;
+
+  // Returns the number of elements smaller than `value`.
+  size_t Rank(T const& value) const;
+
+  // Returns the last node before the first element not smaller than
+  // `value`, or greater than `value` if `upper` is set, and adds its rank to
+  // `rank` if links hold widths.
+  Skip_Node<T, Links>* Bound(T const& value, bool upper,
+                             size_t* rank = nullptr) const;
+
+  // Returns the last node before `value`, searching forward from `from`,
+  // itself before `value`, in O(log d) for d nodes between them.
+  Skip_Node<T, Links>* Seek(Skip_Node<T, Links>* from, T const& value) const;
+
+  // Reduces the elements in the index range [first, last).
+  template <typename R, typename Fold, typename Combine>
+  R ReduceIndices(size_t first, size_t last, R const& identity,
+                  Fold const& fold, Combine const& combine,
+                  size_t threads) const;
+
+  // Creates a new node in `arena`, wraps the node initializer.
+  static Skip_Node<T, Links>* CreateNode(internal::Node_Arena& arena,
+                                         T const* ptr, size_t level) {
+    uint32_t number{0};
+    void* block{arena.allocate(Skip_Node<T, Links>::Size(level),
+                               kNumbered_ ? &number : nullptr)};
+    Skip_Node<T, Links>* node{new (block) Skip_Node<T, Links>(ptr, level)};
+    node->number_ = number;
+    return node;
+  }
+  inline Skip_Node<T, Links>* CreateNode(T const* ptr, size_t level) {
+    return CreateNode(arena_, ptr, level);
+  }
+
+  // Returns `count` empty arenas, one for every thread creating nodes.
+  std::vector<internal::Node_Arena> Arenas(size_t count) const {
+    std::vector<internal::Node_Arena> arenas;
+    arenas.reserve(count);
+    for (size_t i = 0; i < count; i++)
+      arenas.emplace_back(arena_.huge_pages());
+    return arenas;
+  }
 
-  // Creates a new node, wraps the node initializer.
-  inline Skip_Node<T>* CreateNode(T const* ptr, size_t level) {
-    return new jhr::Skip_Node<T>(ptr, level);
+  // Gives the memory of `node` back to the arena, not its data.
+  inline void DeleteNode(Skip_Node<T, Links>* node) {
+    size_t level{node->level()};
+    uint32_t number{node->number_};
+    node->~Skip_Node<T, Links>();
+    arena_.deallocate(node, Skip_Node<T, Links>::Size(level), number);
   }
 
   static std::string CenterString(const std::string& s, size_t width);
 
+  // Header of the snapshots written by `save()`
+  static constexpr char kMagic_[8]{'J', 'H', 'R', 'S', 'K', 'I', 'P', '1'};
+  static constexpr uint32_t kWidthsFlag_{1};
+
+  // Writes the records of every node of the list to `out`.
+  template <typename Writer>
+  void SaveRecords(std::ostream& out, Writer const& write, bool widths) const;
+
+  // Unlinks `x` given its predecessor on every level, deletes the node and
+  // returns the data it held.
+  T const* Unlink(Skip_Node<T, Links>** update, Skip_Node<T, Links>* x);
+
+  // Fills `update` with the predecessor of `x` on every level.
+  void Predecessors(Skip_Node<T, Links> const* x,
+                    Skip_Node<T, Links>** update) const;
+
+  // Links `ptr` in a tower of height `level`, or in place of the data of an
+  // equal element. Unless `kReplace` is set, `ptr` is linked after the equal
+  // elements instead and only `<` is used. Returns the node and the data it
+  // replaced.
+  template <bool kReplace = true>
+  std::pair<Skip_Node<T, Links>*, T const*> InsertNode(T const* ptr,
+                                                       size_t level);
+
+  // Creates an empty list whose nodes are carved out of `arena`, with `head`
+  // a node of `max_level` levels already in it.
+  Skip_List(size_t max_level, float p, internal::Node_Arena&& arena,
+            Skip_Node<T, Links>* head)
+      : kMaxLevel_{max_level},
+        p_{p},
+        arena_{std::move(arena)},
+        head_{head} {}
+
+  // Forgets every node without deleting their data, the list is left empty
+  // with a new arena.
+  void Reset();
+
+  // Moves the nodes after `before[0]` to a new list, given on every level the
+  // last node staying and its rank, and returns the new list.
+  Skip_List SplitAfter(Skip_Node<T, Links>* const* before,
+                       size_t const* before_rank);
+
+  // Unlinks and deletes the nodes after `before[0]` up to `last[0]`
+  // included, given on every level the last node before the span and the
+  // last node of the span, with their ranks, and returns their number.
+  size_t EraseSpan(Skip_Node<T, Links>* const* before,
+                   size_t const* before_rank, Skip_Node<T, Links>* const* last,
+                   size_t const* last_rank);
+
+  // Removes and deletes the elements in [low, high), or in [low, high] if
+  // `closed` is set, and returns how many there were.
+  size_t EraseRange(T const& low, T const& high, bool closed);
+
  public:
+  // Forward iterator over the elements of the skip list, in order.
+  // Walks the bottom level of the list.
+  class iterator {
+   private:
+    friend class Skip_List;
+
+    Skip_List const* list_;
+    Skip_Node<T, Links> const* node_;
+
+   public:
+    using iterator_category =
+        std::conditional_t<kBackLinked_, std::bidirectional_iterator_tag,
+                           std::forward_iterator_tag>;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = T const*;
+    using reference = T const&;
+
+    explicit iterator(Skip_List const* list = nullptr,
+                      Skip_Node<T, Links> const* node = nullptr)
+        : list_{list}, node_{node} {}
+
+    reference operator*() const { return *node_->ptr_; }
+    pointer operator->() const { return node_->ptr_; }
+
+    iterator& operator++() {
+      node_ = list_->Next(node_, 0);
+      return *this;
+    }
+    iterator operator++(int) {
+      iterator it{*this};
+      ++*this;
+      return it;
+    }
+
+    // Steps back to the previous element, from `end()` to the last one.
+    // `back_linked` links only.
+    iterator& operator--() {
+      static_assert(kBackLinked_, "SKIP_LIST: iterating back needs back links");
+      node_ = node_ ? list_->Prev(node_, 0) : list_->Tail(0);
+      return *this;
+    }
+    iterator operator--(int) {
+      iterator it{*this};
+      --*this;
+      return it;
+    }
+
+    bool operator==(iterator const& other) const {
+      return node_ == other.node_;
+    }
+    bool operator!=(iterator const& other) const {
+      return node_ != other.node_;
+    }
+  };
+
+  // An element taken out of a list by `extract()` with the height of its
+  // tower, to be inserted back in a list without copying it. The handle
+  // deletes the element if it is not inserted.
+  class node_handle {
+   private:
+    friend class Skip_List;
+
+    T const* ptr_{nullptr};
+    size_t level_{0};
+
+    node_handle(T const* ptr, size_t level) : ptr_{ptr}, level_{level} {}
+
+   public:
+    node_handle() = default;
+    node_handle(node_handle&& other) noexcept
+        : ptr_{other.ptr_}, level_{other.level_} {
+      other.ptr_ = nullptr;
+    }
+    node_handle& operator=(node_handle&& other) noexcept {
+      if (this != &other) {
+        delete ptr_;
+        ptr_ = other.ptr_;
+        level_ = other.level_;
+        other.ptr_ = nullptr;
+      }
+      return *this;
+    }
+    ~node_handle() { delete ptr_; }
+
+    // Returns `true` if the handle holds no element.
+    bool empty() const { return ptr_ == nullptr; }
+    explicit operator bool() const { return ptr_ != nullptr; }
+
+    T const& value() const { return *ptr_; }
+  };
+
   Skip_List() {}
 
   Skip_List(std::initializer_list<T> initial_values) {
@@ -161,317 +1032,5118 @@ class Skip_List {
   Skip_List(size_t max_level, float p)
       : kMaxLevel_{max_level},
         p_{p},
-        head_{new Skip_Node<T>(nullptr, max_level)} {}
+        head_{CreateNode(nullptr, max_level)} {}
+
+  // The list owns its nodes, copying it would free them twice.
+  Skip_List(Skip_List const&) = delete;
+  Skip_List& operator=(Skip_List const&) = delete;
+
+  // Takes over the nodes of `other`, which is left empty.
+  Skip_List(Skip_List&& other)
+      : kMaxLevel_{other.kMaxLevel_},
+        p_{other.p_},
+        level_{other.level_},
+        width_{other.width_},
+        arena_{std::move(other.arena_)},
+        head_{other.head_},
+        random_{other.random_} {
+    other.Reset();
+  }
 
+  // Deletes the data of the nodes, the arena frees the nodes themselves.
   ~Skip_List() {
     if (!head_) return;
 
-    Skip_Node<T>* node = head_;
+    Skip_Node<T, Links>* node = head_;
     while (node) {
-      Skip_Node<T>* next_node = node->forward_[0].node;
-      delete node;
-      node = next_node;
+      delete node->ptr_;
+      node = Next(node, 0);
     }
   };
 
-  T const& at(size_t index);
-  T const& operator[](size_t index) { return at(index); };
+  // Returns the aggregate under the monoid of `augment` links of the
+  // elements in [low, high), in O(log n).
+  auto aggregate(T const& low, T const& high) const;
+
+  T const& at(size_t index) const;
+  T const& operator[](size_t index) const { return at(index); };
+
+  // Writes the elements at the sorted indices of [first, last) to `out`.
+  // Every search resumes from the path of the previous one, in O(log d) for
+  // indices d apart. Throws an `std::invalid_argument` if the indices are
+  // not sorted.
+  template <typename InputIt, typename OutputIt>
+  void at(InputIt first, InputIt last, OutputIt out) const;
+
+  iterator begin() const { return iterator{this, Next(head_, 0)}; }
+  iterator end() const { return iterator{this, nullptr}; }
+
+  // Iterates over the elements in reverse order, `back_linked` links only.
+  using reverse_iterator = std::reverse_iterator<iterator>;
+  reverse_iterator rbegin() const { return reverse_iterator{end()}; }
+  reverse_iterator rend() const { return reverse_iterator{begin()}; }
+
+  void DisplayList() const;
+
+  // Replaces the content of the list with the sorted range [first, last)
+  // in linear time, using up to `threads` threads (0 for one per core).
+  template <typename RandomIt>
+  void build(RandomIt first, RandomIt last, size_t threads = 0);
+
+  // Removes every element of the list.
+  void clear();
+
+  // Moves every node into fresh memory, in order, so that walking the list
+  // reads memory sequentially, and frees the memory the nodes were in.
+  // Iterators are invalidated, pointers to elements are not.
+  void compact();
 
-  void DisplayList();
+  // Appends the elements of `other`, which must all be greater than the
+  // elements of the list, and leaves `other` empty. The towers of `other` are
+  // linked after the last node of every level, no element is moved: O(log n)
+  // except for `compact_rank` links, renumbered in O(m). Throws an
+  // `std::invalid_argument` if the lists overlap, or if `other` has towers
+  // higher than the maximum level of the list.
+  void concat(Skip_List& other);
+
+  // Inserts an element built from `args`, replacing an equal element.
+  // Returns an iterator to the element, which stays valid until the element
+  // is removed or the list compacted, and the replaced element to delete, or
+  // a null pointer.
+  template <typename... Args>
+  std::pair<iterator, T const*> emplace(Args&&... args);
 
   // Returns `true` if the skip list is empty.
-  inline bool empty() { return !head_->forward_[0].node; }
+  inline bool empty() const { return !Next(head_, 0); }
+
+  // Removes and deletes the elements in [low, high), or at the indices in
+  // [first, last), and returns how many there were. Both ends of the span
+  // are found once and it is unlinked on every level at once, in
+  // O(log n + k).
+  size_t erase(T const& low, T const& high) {
+    return EraseRange(low, high, false);
+  }
+  size_t erase_at(size_t first, size_t last);
+
+  // Removes and deletes the element at `position` and returns an iterator to
+  // the next one. Its predecessors are found by a descent stopping at its
+  // node, the element is never compared for equality.
+  iterator erase(iterator position);
+
+  // Unlinks the element equal to `value`, or at `position`, and returns it
+  // in a handle, empty if there is none. The element is neither copied nor
+  // deleted and the memory of its node is kept by the list for the next
+  // insertion.
+  node_handle extract(T const& value);
+  node_handle extract(iterator position);
 
   // TODO FIX
-  T const* find(T const& ptr);
+  T const* find(T const& ptr) const;
+
+  // Returns a read-only copy of the list laid out for searching, see
+  // `Frozen_Skip_List`. The list is left unchanged.
+  Frozen_Skip_List<T> freeze() const;
 
   // TODO FIX
   T const* insert(T const& ptr);
 
+  // Links the element of `node` in the list in a tower of the same height,
+  // replacing an equal element, and leaves `node` empty. Returns an iterator
+  // to the element and the replaced element to delete, or a null pointer.
+  std::pair<iterator, T const*> insert(node_handle&& node);
+
+  // Inserts the unsorted range [first, last), replacing equal elements.
+  // The batch is sorted and merged with the list using up to `threads`
+  // threads (0 for one per core).
+  template <typename InputIt>
+  void insert_bulk(InputIt first, InputIt last, size_t threads = 0);
+
   // Returns the length of the skip list.
-  inline size_t length() { return width_; }
+  inline size_t length() const { return width_; }
+
+  // Replaces the content of the list with a snapshot written by `save()`.
+  // Elements are read with `read(in)`, by default the bytes of trivially
+  // copyable elements. Throws an `std::runtime_error` if the snapshot is
+  // corrupted, the list is then left empty.
+  void load(std::istream& in);
+  void load(std::string const& path);
+  template <typename Reader>
+  void load(std::istream& in, Reader const& read);
+
+  // Returns an iterator to the first element not smaller than `value`.
+  iterator lower_bound(T const& value) const;
 
   static size_t MaxLevel(size_t N /*maximum number of elements*/, float p);
 
+  // Moves the elements of `other` into the list, replacing equal elements,
+  // and leaves `other` empty. The nodes of both lists are merged in order
+  // and relinked in O(n + m), without copying any element. Lists that do
+  // not overlap are concatenated, small lists and lists with towers higher
+  // than the maximum level of the list are inserted one by one, their
+  // towers cut down.
+  void merge(Skip_List& other);
+
+  // Calls `function(element)` on every element, or every element in
+  // [low, high), splitting the list between up to `threads` threads (0 for
+  // one per core).
+  template <typename Function>
+  void parallel_for_each(Function const& function, size_t threads = 0) const;
+  template <typename Function>
+  void parallel_for_each(T const& low, T const& high, Function const& function,
+                         size_t threads = 0) const;
+
+  // Folds every element, or every element in [low, high), into a value with
+  // `fold(value, element)` on up to `threads` threads (0 for one per core),
+  // then merges the values of the threads in order with
+  // `combine(left, right)`.
+  template <typename R, typename Fold, typename Combine>
+  R parallel_reduce(R const& identity, Fold const& fold, Combine const& combine,
+                    size_t threads = 0) const;
+  template <typename R, typename Fold, typename Combine>
+  R parallel_reduce(T const& low, T const& high, R const& identity,
+                    Fold const& fold, Combine const& combine,
+                    size_t threads = 0) const;
+
+  // Returns the smallest element, or a null pointer if the list is empty,
+  // in O(1).
+  T const* peek_min() const {
+    Skip_Node<T, Links> const* x{Next(head_, 0)};
+    return x ? x->ptr_ : nullptr;
+  }
+
+  // Removes the largest element and returns it, or a null pointer if the
+  // list is empty. The last node and its predecessors are found without
+  // comparing any element, read from the back links of the head with
+  // `back_linked` links.
+  T const* pop_max();
+
+  // Removes the smallest element and returns it, or a null pointer if the
+  // list is empty. The first node is unlinked from the head on its levels
+  // and the widths above it shortened, with no search.
+  T const* pop_min();
+
   // TODO FIX
   T const* remove(T const& ptr);
 
+  // Removes the element at a particular index and returns it.
+  T const* remove_at(size_t index);
+
+  // Writes the elements in order with their tower heights, and their widths
+  // if `widths` is set, behind a header holding a checksum. Elements are
+  // written with `write(out, element)`, by default as the bytes of trivially
+  // copyable elements.
+  void save(std::ostream& out, bool widths = false) const;
+  void save(std::string const& path, bool widths = false) const;
+  template <typename Writer>
+  void save(std::ostream& out, Writer const& write, bool widths = false) const;
+
+  // Carves the nodes created from now on out of 2 MiB huge pages when the
+  // system supports them, to spare TLB misses on large lists. `compact()`
+  // moves the existing nodes.
+  void set_huge_pages(bool enable = true) { arena_.set_huge_pages(enable); }
+
+  // Return a new list holding copies of the elements found in the list or in
+  // `other`, equal elements being taken from `other` (`set_union()`), in
+  // both lists (`set_intersection()`) or in the list only
+  // (`set_difference()`). The towers of the new list are linked as its
+  // nodes are created in order. Intersections and differences walk one list
+  // and seek its elements in the other with finger searches, in
+  // O(m log(n / m)) for m elements walked.
+  Skip_List set_difference(Skip_List const& other) const;
+  Skip_List set_intersection(Skip_List const& other) const;
+  Skip_List set_union(Skip_List const& other) const;
+
+  // Moves the elements not smaller than `value`, or from `index` on, to a
+  // new list and returns it. The towers are cut along a single search path
+  // in O(log n), no element is moved. The two lists share the memory the
+  // nodes were in until both are compacted or destroyed. With `no_rank`
+  // links the moved elements are counted, in O(n).
+  Skip_List split_at(T const& value);
+  Skip_List split_at_index(size_t index);
+
   // TODO add + operator support
   // add an arry or an other skip list ?
 };
-}  // namespace jhr
-#endif  // JHR_SKIP_LIST_H
-#ifdef JHR_SKIP_LIST_IMPLEMENTATION
 
-// Returns the `index`th element of the skip list.
-// If `index` is greater than the width of the skip list returns a null
-// pointer.
+// An immutable copy of a skip list, for long read-only phases.
+//
+// The elements are stored twice in flat arrays: in order, so that `at()` is
+// O(1) and iterating is sequential, and in Eytzinger order (the breadth-first
+// order of a complete binary search tree) for searching. A search walks the
+// second array from the root without branching on the comparison, its first
+// levels sharing a few cache lines.
 template <typename T>
-T const& jhr::Skip_List<T>::at(size_t index) {
-  if (index >= width_) throw std::overflow_error("SKIP_LIST");
+class Frozen_Skip_List {
+ private:
+  // Elements in Eytzinger order, starting at index 1. The children of
+  // `keys_[k]` are `keys_[2 * k]` and `keys_[2 * k + 1]`.
+  std::vector<T> keys_;
 
-  size_t w{index + 1};
+  // Index in `values_` of every element of `keys_`.
+  std::vector<size_t> ranks_;
 
-  jhr::Skip_Node<T>* x{head_};
+  // Elements in order
+  std::vector<T> values_;
 
-  for (size_t i = level_; i > 0; i--) {
-    while (x->forward_[i - 1].node != nullptr &&
-           x->forward_[i - 1].width <= w) {
-      w -= x->forward_[i - 1].width;
-      x = x->forward_[i - 1].node;
-      if (w == 0) {
-        assert(x->ptr_ != nullptr);
-        return *x->ptr_;
+  // Fills `ranks_` with the in-order ranks of the subtree rooted at `k`,
+  // `rank` being the next rank to give.
+  void Layout(size_t k, size_t& rank);
+
+  // Returns the index of the first element not smaller than `value`.
+  size_t Search(T const& value) const;
+
+ public:
+  using iterator = typename std::vector<T>::const_iterator;
+
+  // `values` must be sorted and hold no equal elements.
+  explicit Frozen_Skip_List(std::vector<T> values);
+
+  // Returns the element at `index` in O(1).
+  T const& at(size_t index) const;
+  T const& operator[](size_t index) const { return at(index); };
+
+  iterator begin() const { return values_.begin(); }
+  iterator end() const { return values_.end(); }
+
+  // Returns `true` if the list is empty.
+  inline bool empty() const { return values_.empty(); }
+
+  // Returns a pointer to the element equal to `value`, or a null pointer.
+  T const* find(T const& value) const;
+
+  // Returns the length of the list.
+  inline size_t length() const { return values_.size(); }
+
+  // Returns an iterator to the first element not smaller than `value`.
+  iterator lower_bound(T const& value) const;
+
+  // Replaces the content of `list` with the elements, in linear time.
+  template <typename Links>
+  void thaw(Skip_List<T, Links>& list, size_t threads = 0) const;
+};
+
+// A skip list keeping equal elements, in insertion order: an element is
+// linked after the elements equal to it rather than replacing them, so that
+// the elements are only ever compared with `<`.
+//
+// Equal elements form a run of the bottom level. `count()` takes the
+// difference of the ranks of both ends of the run in O(log n), and
+// `erase()` unlinks a whole run on every level at once.
+template <typename T, typename Links>
+class Skip_Multiset {
+ private:
+  Skip_List<T, Links> list_;
+
+ public:
+  using iterator = typename Skip_List<T, Links>::iterator;
+  using reverse_iterator = typename Skip_List<T, Links>::reverse_iterator;
+
+  Skip_Multiset() {}
+  Skip_Multiset(size_t max_level, float p) : list_(max_level, p) {}
+
+  T const& at(size_t index) const { return list_.at(index); }
+  T const& operator[](size_t index) const { return at(index); };
+  template <typename InputIt, typename OutputIt>
+  void at(InputIt first, InputIt last, OutputIt out) const {
+    list_.at(first, last, out);
+  }
+
+  iterator begin() const { return list_.begin(); }
+  iterator end() const { return list_.end(); }
+  reverse_iterator rbegin() const { return list_.rbegin(); }
+  reverse_iterator rend() const { return list_.rend(); }
+
+  // Removes every element.
+  void clear() { list_.clear(); }
+
+  // Returns the number of elements equal to `value`, in O(log n). With
+  // `no_rank` links the equal elements are walked, in O(log n + k).
+  size_t count(T const& value) const;
+
+  // Inserts an element built from `args` after the elements equal to it and
+  // returns an iterator to it.
+  template <typename... Args>
+  iterator emplace(Args&&... args);
+
+  // Returns `true` if the multiset is empty.
+  inline bool empty() const { return list_.empty(); }
+
+  // Returns the range of the elements equal to `value`, in insertion order.
+  std::pair<iterator, iterator> equal_range(T const& value) const;
+
+  // Removes and deletes every element equal to `value`, or only the first
+  // one inserted if `all` is not set, and returns how many there were.
+  size_t erase(T const& value, bool all = true);
+
+  // Removes and deletes the element at `position` and returns an iterator to
+  // the next one.
+  iterator erase(iterator position) { return list_.erase(position); }
+
+  // Returns an iterator to the first element inserted equal to `value`, or
+  // `end()`.
+  iterator find(T const& value) const;
+
+  // Inserts `value` after the elements equal to it and returns an iterator
+  // to it.
+  iterator insert(T const& value) { return emplace(value); }
+
+  // Returns the number of elements.
+  inline size_t length() const { return list_.length(); }
+
+  // Returns an iterator to the first element not smaller than `value`, or
+  // greater than `value`.
+  iterator lower_bound(T const& value) const;
+  iterator upper_bound(T const& value) const;
+
+  // Removes the smallest element, the first one inserted if several are
+  // equal, and returns it, or a null pointer if the multiset is empty.
+  T const* pop_min() { return list_.pop_min(); }
+
+  // Removes the element at a particular index and returns it.
+  T const* remove_at(size_t index) { return list_.remove_at(index); }
+};
+
+// The last `capacity` samples of a stream, kept in a `Skip_Multiset` for
+// order statistics such as a rolling median or percentiles.
+//
+// Every sample is inserted after the samples equal to it, and a FIFO of
+// iterators to their nodes evicts them in arrival order. The oldest sample
+// is the first of its run of equal samples: evicting it never walks over the
+// others. `quantile()` reads a sample by index through the widths in
+// O(log n), and `quantiles()` reads several along a shared search path.
+template <typename T, typename Links = ranked>
+class Sliding_Window {
+ private:
+  static_assert(!std::is_same<Links, no_rank>::value,
+                "SKIP_LIST: no_rank links hold no widths");
+
+  const size_t kCapacity_;
+
+  Skip_Multiset<T, Links> samples_;
+
+  // Iterators to the samples, oldest first
+  std::deque<typename Skip_Multiset<T, Links>::iterator> arrivals_;
+
+  // Returns the index of the `q` quantile, throws an `std::overflow_error`
+  // if the window is empty and an `std::invalid_argument` if `q` is not in
+  // [0, 1].
+  size_t QuantileIndex(double q) const;
+
+ public:
+  using iterator = typename Skip_Multiset<T, Links>::iterator;
+
+  // Throws an `std::invalid_argument` if `capacity` is 0.
+  explicit Sliding_Window(size_t capacity);
+
+  // Iterates over the samples in order.
+  iterator begin() const { return samples_.begin(); }
+  iterator end() const { return samples_.end(); }
+
+  // Returns the number of samples the window keeps.
+  inline size_t capacity() const { return kCapacity_; }
+
+  // Removes every sample.
+  void clear();
+
+  // Returns `true` if the window holds no sample.
+  inline bool empty() const { return arrivals_.empty(); }
+
+  // Returns the number of samples in the window.
+  inline size_t length() const { return arrivals_.size(); }
+
+  // Adds `sample`, evicting the oldest sample if the window is full.
+  void push(T const& sample);
+
+  // Returns the `q` quantile of the samples, the sample at index
+  // `q * (length() - 1)` rounded down, in O(log n). `quantile(0.5)` is the
+  // lower median.
+  T const& quantile(double q) const;
+
+  // Returns the quantiles `qs`, in the same order, along one search path.
+  std::vector<T> quantiles(std::vector<double> const& qs) const;
+};
+
+// A skip list whose elements expire. Every element carries a deadline, and
+// a companion `Skip_Multiset` orders the deadlines, each one pointing back
+// to its element.
+//
+// `sweep(now, budget)` removes the expired elements from the front of the
+// deadlines, at most `budget` of them, so that the cleanup work done per
+// call is bounded rather than a scan of the whole list. Expired elements
+// not swept yet are hidden from `find()`.
+template <typename T, typename Clock = std::chrono::steady_clock>
+class Expiring_Skip_List {
+ public:
+  using time_point = typename Clock::time_point;
+
+ private:
+  struct Entry;
+
+  // An element of the deadline list: a deadline and the entry expiring then
+  struct Expiry {
+    time_point deadline_;
+    Entry const* entry_;
+
+    bool operator<(Expiry const& other) const {
+      return deadline_ < other.deadline_;
+    }
+  };
+
+  // An element of the underlying list: its key and its deadline
+  struct Entry {
+    T key_;
+    time_point deadline_;
+    // Node of the deadline in `deadlines_`, not part of the key
+    mutable typename Skip_Multiset<Expiry, no_rank>::iterator expiry_;
+
+    explicit Entry(T const& key, time_point deadline = {})
+        : key_{key}, deadline_{deadline} {}
+
+    bool operator<(Entry const& other) const { return key_ < other.key_; }
+    bool operator==(Entry const& other) const { return key_ == other.key_; }
+  };
+
+  // Neither list is accessed by index
+  Skip_List<Entry, no_rank> entries_;
+  Skip_Multiset<Expiry, no_rank> deadlines_;
+
+ public:
+  Expiring_Skip_List() {}
+
+  // Removes every element.
+  void clear();
+
+  // Returns `true` if the list holds no element, expired or not.
+  inline bool empty() const { return entries_.empty(); }
+
+  // Returns the element equal to `value` if it has not expired by `now`, or
+  // a null pointer.
+  T const* find(T const& value, time_point now = Clock::now()) const;
+
+  // Inserts `value` expiring at `deadline`, replacing an equal element and
+  // its deadline. Returns `true` if the element was not in the list.
+  bool insert(T const& value, time_point deadline);
+
+  // Returns the number of elements, expired or not.
+  inline size_t length() const { return entries_.length(); }
+
+  // Returns the earliest deadline, if the list is not empty.
+  std::optional<time_point> next_deadline() const;
+
+  // Removes the element equal to `value`. Returns `true` if there was one.
+  bool remove(T const& value);
+
+  // Removes up to `budget` elements expired by `now`, earliest deadline
+  // first, and returns how many were removed. Each one costs O(log n).
+  size_t sweep(time_point now, size_t budget = SIZE_MAX);
+};
+
+// Closed intervals [low, high] indexed with Hanson's markers.
+//
+// The endpoints of the intervals are the nodes of a skip list. Every interval
+// is marked along a path from its low to its high endpoint, climbing as high
+// as its links stay inside the interval: a marker on a link means that the
+// interval contains the whole link, a marker on a node that it contains the
+// node. A search for a point picks up the markers of the links it drops down
+// from and of the node it lands on, exactly the intervals containing the
+// point, in O(log n + k).
+//
+// A tower inserted or removed changes the links below its height between its
+// neighbours on its top level. The intervals marked there are unmarked there
+// first and marked again along their new paths, the rest of their paths
+// staying as they are.
+template <typename T>
+class Interval_Skip_List {
+ public:
+  struct Interval {
+    T low;
+    T high;
+  };
+
+ private:
+  struct Endpoint;
+  struct Record;
+
+  using Links = internal::marked<Record*>;
+  using Node = Skip_Node<Endpoint, Links>;
+
+  struct Record {
+    Interval interval_;
+    // Nodes of the endpoints, which stay in place until the record is gone
+    Node* low_;
+    Node* high_;
+    // Set while the record is queued to be marked again
+    bool affected_{false};
+  };
+
+  // A node of the list, the endpoint of one or more intervals
+  struct Endpoint {
+    T key_;
+    // The intervals starting at the endpoint own their records
+    mutable std::vector<std::unique_ptr<Record>> starts_;
+    // Number of intervals ending at the endpoint
+    mutable size_t ends_{0};
+    // Intervals marked on the node
+    mutable std::vector<Record*> markers_;
+
+    explicit Endpoint(T const& key) : key_{key} {}
+
+    bool operator<(Endpoint const& other) const { return key_ < other.key_; }
+    bool operator==(Endpoint const& other) const {
+      return key_ == other.key_;
+    }
+  };
+
+  Skip_List<Endpoint, Links> list_;
+
+  size_t length_{0};
+
+  // Returns the node of `key`, creating it if needed.
+  Node* AddEndpoint(T const& key);
+
+  // Removes the node `x` if no interval starts or ends there anymore.
+  void DropEndpoint(Node* x);
+
+  // Returns the node of `key`, or a null pointer.
+  Node* Find(T const& key) const;
+
+  // Frees the markers of every link.
+  void FreeMarkers();
+
+  // Marks `record` along its path, or removes its markers if `place` is not
+  // set.
+  void Mark(Record* record, bool place);
+
+  // Marks `record`, or removes its markers, along the part of its path from
+  // `from` to `to`, the markers of both nodes excepted.
+  void Mark(Record* record, bool place, Node* from, Node const* to);
+
+  // Calls `change()`, which inserts or removes a tower of height `levels`
+  // between `first` and `last`, consecutive nodes of its top level. The
+  // intervals marked on the links below `levels` from `first` up to `last`
+  // are unmarked there before the change and marked again after it.
+  template <typename Change>
+  void Restructure(Node* first, Node const* last, size_t levels,
+                   Change const& change);
+
+  // Adds `record` to `markers`, or removes it if `place` is not set.
+  static void SetMarker(std::vector<Record*>& markers, Record* record,
+                        bool place);
+
+ public:
+  Interval_Skip_List() {}
+  ~Interval_Skip_List() { FreeMarkers(); }
+
+  Interval_Skip_List(Interval_Skip_List const&) = delete;
+  Interval_Skip_List& operator=(Interval_Skip_List const&) = delete;
+
+  // Removes every interval.
+  void clear();
+
+  // Returns `true` if the list holds no interval.
+  inline bool empty() const { return length_ == 0; }
+
+  // Inserts the interval [low, high], equal intervals are kept. Throws an
+  // `std::invalid_argument` if `high < low`.
+  void insert(T const& low, T const& high);
+
+  // Returns the number of intervals.
+  inline size_t length() const { return length_; }
+
+  // Returns the intervals overlapping [low, high]: the intervals containing
+  // `low` and the intervals starting in (low, high], in O(log n + k).
+  std::vector<Interval> overlap(T const& low, T const& high) const;
+
+  // Removes one interval equal to [low, high]. Returns `true` if there was
+  // one.
+  bool remove(T const& low, T const& high);
+
+  // Returns the intervals containing `point`, in O(log n + k).
+  std::vector<Interval> stab(T const& point) const;
+};
+
+// A skip list split into key ranges, each range being a plain `Skip_List`
+// guarded by its own lock. Writers to different ranges never contend.
+//
+// A small router array holds the lowest key of every shard but the first.
+// Shards that grow past twice the average size are split in two, and the
+// smallest pair of neighbouring shards is merged back to keep about
+// `shard_count` shards.
+template <typename T>
+class Sharded_Skip_List {
+ private:
+  struct Shard {
+    // Guards `list_`
+    mutable std::mutex mutex_;
+    Skip_List<T> list_;
+    // Copy of `list_.length()` that can be read without holding `mutex_`
+    std::atomic<size_t> size_{0};
+  };
+
+  // Shards are never split below this size.
+  static constexpr size_t kMinShardSize_{1024};
+
+  // Number of shards the list tries to keep.
+  const size_t kShardCount_;
+
+  // Guards `bounds_` and `shards_`. Held shared by every operation and
+  // exclusively while rebalancing.
+  mutable std::shared_mutex router_mutex_;
+
+  // `bounds_[i]` is the smallest key stored in `shards_[i + 1]`.
+  std::vector<T> bounds_;
+
+  std::vector<std::unique_ptr<Shard>> shards_;
+
+  std::atomic<size_t> width_{0};
+
+  // Returns the index of the shard `value` is routed to.
+  size_t Route(T const& value) const;
+
+  // Returns `true` if `shard` is skewed enough to be worth a rebalance.
+  bool IsSkewed(Shard const& shard) const;
+
+  // Splits `shards_[index]` in two halves of equal size.
+  void Split(size_t index);
+
+  // Merges `shards_[index + 1]` into `shards_[index]`.
+  void Merge(size_t index);
+
+ public:
+  explicit Sharded_Skip_List(size_t shard_count = 16);
+
+  Sharded_Skip_List(Sharded_Skip_List const&) = delete;
+  Sharded_Skip_List& operator=(Sharded_Skip_List const&) = delete;
+
+  // Returns a copy of the `index`th element of the list.
+  T at(size_t index) const;
+
+  // Returns `true` if the sharded list is empty.
+  inline bool empty() const { return length() == 0; }
+
+  // Returns a copy of the element equal to `value` if there is one.
+  std::optional<T> find(T const& value) const;
+
+  // Inserts `value`, replacing any equal element. Returns `true` if the
+  // element was not already in the list.
+  bool insert(T const& value);
+
+  // Returns the length of the sharded list.
+  inline size_t length() const { return width_.load(); }
+
+  // Rebalances the shards until none of them is skewed.
+  void Rebalance();
+
+  // Removes the element equal to `value`. Returns `true` if there was one.
+  bool remove(T const& value);
+
+  // Returns the current number of shards.
+  size_t shards() const;
+};
+// A concurrent priority queue spread over several skip lists ("lanes"), each
+// one guarded by its own lock. Elements are pushed to a random lane.
+//
+// `pop_min()` is exact and locks every lane. `pop_spray()` is relaxed: like a
+// SprayList it removes one of the first O(p log^3 p) elements, where p is the
+// number of threads, by landing on a random element near the front of a
+// random lane. Concurrent sprays rarely touch the same lane or element.
+//
+// Lanes are `Skip_Multiset`s: equal elements are all kept, and those landing
+// in the same lane are popped in the order they were pushed.
+template <typename T>
+class Concurrent_Priority_Queue {
+ private:
+  struct Lane {
+    // Guards `list_`
+    mutable std::mutex mutex_;
+    Skip_Multiset<T> list_;
+  };
+
+  std::vector<std::unique_ptr<Lane>> lanes_;
+
+  // Number of elements at the front of a lane a spray can land on.
+  const size_t kSprayWidth_;
+
+  std::atomic<size_t> width_{0};
+
+  // Returns the random engine of the calling thread.
+  static std::minstd_rand& Random();
+
+  // Returns the index of a random lane.
+  size_t RandomLane() const;
+
+  // Removes the element at `index` in the locked `lane`.
+  T PopAt(Lane& lane, size_t index);
+
+ public:
+  // `threads` is the expected number of concurrent consumers.
+  explicit Concurrent_Priority_Queue(
+      size_t threads = std::thread::hardware_concurrency());
+
+  Concurrent_Priority_Queue(Concurrent_Priority_Queue const&) = delete;
+  Concurrent_Priority_Queue& operator=(Concurrent_Priority_Queue const&) =
+      delete;
+
+  // Returns `true` if the queue is empty.
+  inline bool empty() const { return length() == 0; }
+
+  // Returns the number of elements in the queue.
+  inline size_t length() const { return width_.load(); }
+
+  // Removes and returns the smallest element, if any.
+  std::optional<T> pop_min();
+
+  // Removes and returns one of the smallest elements, if any.
+  std::optional<T> pop_spray();
+
+  // Pushes `value` in a random lane.
+  void push(T const& value);
+};
+// A skip list keeping several versions of its elements so that readers can
+// work on a consistent snapshot while a writer keeps modifying the list.
+//
+// Every write is tagged with an increasing sequence number. An element holds
+// the chain of its versions, newest first, a removal being a version with no
+// data. A `Snapshot` sees the versions written up to the sequence number it
+// was taken at, and keeps them alive until it is destroyed. Versions older
+// than the oldest live snapshot are trimmed when their element is written and
+// by `collect()`.
+//
+// Readers and the writer only hold the lock for the duration of a single
+// step, long iterations over a snapshot never block the writer.
+template <typename T>
+class Versioned_Skip_List {
+ private:
+  struct Version {
+    uint64_t sequence_;
+    // Data of the version, null for a removal
+    std::unique_ptr<T const> data_;
+    std::unique_ptr<Version> older_;
+  };
+
+  // An element of the underlying list: its key and its versions
+  struct Entry {
+    T key_;
+    // The chain is not part of the key, it is updated in place
+    mutable std::unique_ptr<Version> newest_;
+
+    explicit Entry(T const& key) : key_{key} {}
+    Entry(Entry const& other) : key_{other.key_} {
+      std::unique_ptr<Version>* copy{&newest_};
+      for (Version const* v = other.newest_.get(); v; v = v->older_.get()) {
+        *copy = std::make_unique<Version>(Version{
+            v->sequence_,
+            v->data_ ? std::make_unique<T const>(*v->data_) : nullptr,
+            nullptr});
+        copy = &(*copy)->older_;
+      }
+    }
+
+    bool operator<(Entry const& other) const { return key_ < other.key_; }
+    bool operator==(Entry const& other) const { return key_ == other.key_; }
+  };
+
+  // Guards `list_`, held exclusively by writes
+  mutable std::shared_mutex mutex_;
+
+  Skip_List<Entry> list_;
+
+  // Sequence number of the last write
+  uint64_t sequence_{0};
+
+  // Number of elements in the latest version of the list
+  size_t width_{0};
+
+  // Guards `snapshots_`
+  mutable std::mutex snapshots_mutex_;
+
+  // Sequence numbers of the live snapshots
+  mutable std::multiset<uint64_t> snapshots_;
+
+  // Returns the sequence number of the oldest live snapshot.
+  uint64_t Oldest() const;
+
+  // Releases a snapshot taken at `sequence`.
+  void Release(uint64_t sequence) const;
+
+  // Drops the versions of `entry` no snapshot can see anymore. Returns `true`
+  // if the entry itself is not visible anymore and can be unlinked.
+  static bool Trim(Entry const& entry, uint64_t oldest);
+
+  // Returns the data of `entry` as of `sequence`, null if it did not exist.
+  static T const* Visible(Entry const& entry, uint64_t sequence);
+
+ public:
+  // A consistent view of the list as of a sequence number.
+  class Snapshot {
+   private:
+    Versioned_Skip_List const* list_;
+    uint64_t sequence_;
+
+    friend class Versioned_Skip_List;
+
+    Snapshot(Versioned_Skip_List const* list, uint64_t sequence)
+        : list_{list}, sequence_{sequence} {}
+
+   public:
+    // Forward iterator over the elements visible in the snapshot. It holds
+    // the list and the sequence number rather than the snapshot, so that
+    // moving the snapshot keeps it valid.
+    class iterator {
+     private:
+      Versioned_Skip_List const* list_;
+      uint64_t sequence_;
+      typename Skip_List<Entry>::iterator it_;
+      // Data of the current entry as of the snapshot
+      T const* data_{nullptr};
+
+      friend class Snapshot;
+
+      // Settles on the first entry from `it` visible as of `sequence`.
+      // Must be called with the list lock held, so that the entry `it`
+      // points to cannot be unlinked first.
+      iterator(Versioned_Skip_List const* list, uint64_t sequence,
+               typename Skip_List<Entry>::iterator it)
+          : list_{list}, sequence_{sequence}, it_{it} {
+        if (list_ != nullptr) Settle();
+      }
+
+      // Skips the entries the snapshot cannot see.
+      // Must be called with the list lock held.
+      void Settle() {
+        for (; it_ != typename Skip_List<Entry>::iterator{}; ++it_) {
+          data_ = Visible(*it_, sequence_);
+          if (data_) return;
+        }
+      }
+
+     public:
+      using iterator_category = std::forward_iterator_tag;
+      using value_type = T;
+      using difference_type = std::ptrdiff_t;
+      using pointer = T const*;
+      using reference = T const&;
+
+      // Versions visible in a snapshot are never freed while the snapshot
+      // lives, the data can be read without holding the lock.
+      reference operator*() const { return *data_; }
+      pointer operator->() const { return data_; }
+
+      iterator& operator++() {
+        std::shared_lock<std::shared_mutex> lock{list_->mutex_};
+        ++it_;
+        Settle();
+        return *this;
+      }
+      iterator operator++(int) {
+        iterator it{*this};
+        ++*this;
+        return it;
+      }
+
+      bool operator==(iterator const& other) const { return it_ == other.it_; }
+      bool operator!=(iterator const& other) const { return it_ != other.it_; }
+    };
+
+    Snapshot(Snapshot const&) = delete;
+    Snapshot& operator=(Snapshot const&) = delete;
+
+    Snapshot(Snapshot&& other)
+        : list_{other.list_}, sequence_{other.sequence_} {
+      other.list_ = nullptr;
+    }
+    // Releases the snapshot held before taking over `other`.
+    Snapshot& operator=(Snapshot&& other) {
+      if (this != &other) {
+        if (list_) list_->Release(sequence_);
+        list_ = other.list_;
+        sequence_ = other.sequence_;
+        other.list_ = nullptr;
+      }
+      return *this;
+    }
+
+    ~Snapshot() {
+      if (list_) list_->Release(sequence_);
+    }
+
+    // Returns the `index`th element visible in the snapshot.
+    // The widths count every version, this walks the list in O(n).
+    T const& at(size_t index) const;
+
+    // Iterators stay valid as long as the snapshot, or the snapshot it was
+    // moved to, lives.
+    iterator begin() const;
+    iterator end() const {
+      return iterator{nullptr, sequence_,
+                      typename Skip_List<Entry>::iterator{}};
+    }
+
+    // Returns the element equal to `value` as of the snapshot, if any.
+    T const* find(T const& value) const;
+
+    // Returns the sequence number the snapshot was taken at.
+    inline uint64_t sequence() const { return sequence_; }
+  };
+
+  Versioned_Skip_List() {}
+
+  Versioned_Skip_List(Versioned_Skip_List const&) = delete;
+  Versioned_Skip_List& operator=(Versioned_Skip_List const&) = delete;
+
+  // Drops every version no live snapshot can see and unlinks the removed
+  // elements. Walks the whole list while holding the lock.
+  void collect();
+
+  // Returns `true` if the latest version of the list is empty.
+  inline bool empty() const { return length() == 0; }
+
+  // Returns a copy of the latest version of the element equal to `value`.
+  std::optional<T> find(T const& value) const;
+
+  // Inserts a new version of `value`. Returns `true` if the element was not
+  // already in the list.
+  bool insert(T const& value);
+
+  // Returns the number of elements in the latest version of the list.
+  size_t length() const;
+
+  // Removes the element equal to `value`. Returns `true` if there was one.
+  bool remove(T const& value);
+
+  // Returns the sequence number of the last write.
+  uint64_t sequence() const;
+
+  // Takes a snapshot of the current version of the list.
+  Snapshot snapshot() const;
+};
+// An immutable file of sorted elements, as written by the flush of a
+// `Skip_Memtable`.
+//
+// Elements are written in blocks of about `kBlockSize_` bytes, each block
+// starting with its number of elements. A sparse index holding the offset,
+// size and first element of every block follows the blocks, and a footer
+// holding the offset of the index ends the file. Finding an element reads
+// the index once, then a single block.
+template <typename T>
+class Sorted_Run {
+ public:
+  using Reader = std::function<T(std::istream&)>;
+  using Writer = std::function<void(std::ostream&, T const&)>;
+
+ private:
+  static constexpr size_t kBlockSize_{4096};
+  static constexpr uint64_t kMagic_{0x4e5552534b4a4852ULL};  // "JHRSKRUN"
+
+  struct Block {
+    uint64_t offset;
+    uint32_t size;
+    T first;
+  };
+
+  Reader read_;
+  std::vector<Block> index_;
+  size_t width_{0};
+
+  // Guards `in_`
+  mutable std::mutex mutex_;
+  mutable std::ifstream in_;
+
+  // Returns `read`, or a reader of the bytes of trivially copyable elements.
+  static Reader ReaderOrDefault(Reader read);
+
+ public:
+  // Returns `write`, or a writer of the bytes of trivially copyable elements.
+  static Writer WriterOrDefault(Writer write);
+
+  // Opens the run at `path`, elements are read with `read(in)`, by default
+  // the bytes of trivially copyable elements.
+  explicit Sorted_Run(std::string const& path, Reader read = nullptr);
+
+  // Returns a copy of the element equal to `value`, if any.
+  std::optional<T> find(T const& value) const;
+
+  // Returns the number of elements in the run.
+  inline size_t length() const { return width_; }
+
+  // Writes the elements of `list` in a run at `path`, elements are written
+  // with `write(out, element)`, by default as the bytes of trivially
+  // copyable elements.
+  static void write(std::string const& path, Skip_List<T> const& list,
+                    Writer write = nullptr);
+};
+
+// A write buffer for a log-structured merge tree.
+//
+// Elements are inserted in an active `Skip_List` while its approximate memory
+// usage is tracked. Once it reaches `threshold` bytes the list is frozen: it
+// becomes immutable, a fresh list takes its place, and a background thread
+// streams the frozen list to a `Sorted_Run` file. Inserts never wait for a
+// flush, lookups see the active list then the frozen lists not yet flushed,
+// newest first. A run that cannot be written stops the flusher, and every
+// later write throws its error rather than piling up frozen lists.
+template <typename T>
+class Skip_Memtable {
+ public:
+  using Writer = typename Sorted_Run<T>::Writer;
+  using Sizer = std::function<size_t(T const&)>;
+
+ private:
+  // Guards everything below
+  mutable std::shared_mutex mutex_;
+  // Wakes the flusher up
+  std::condition_variable_any pending_;
+  // Wakes up the threads waiting for the frozen lists to be written
+  mutable std::condition_variable_any flushed_;
+
+  std::unique_ptr<Skip_List<T>> active_{std::make_unique<Skip_List<T>>()};
+  // Approximate number of bytes used by `active_`
+  size_t usage_{0};
+
+  // Frozen lists waiting to be flushed, newest first
+  std::deque<std::shared_ptr<Skip_List<T> const>> frozen_;
+
+  // Paths of the runs written so far, oldest first
+  std::vector<std::string> runs_;
+
+  const std::string prefix_;
+  const size_t kThreshold_;
+  const Writer write_;
+  const Sizer size_of_;
+  // Error that stopped the flusher, if any
+  std::exception_ptr error_;
+  bool stop_{false};
+
+  std::thread flusher_;
+
+  // Writes the frozen lists to runs, oldest first, until the memtable is
+  // destroyed.
+  void Flush();
+
+  // Freezes the active list. Must be called with `mutex_` held exclusively.
+  void Rotate();
+
+ public:
+  // Runs are written at `prefix` followed by their number. `size_of`
+  // returns the bytes owned by an element besides the element itself.
+  Skip_Memtable(std::string const& prefix, size_t threshold,
+                Writer write = nullptr, Sizer size_of = nullptr);
+
+  Skip_Memtable(Skip_Memtable const&) = delete;
+  Skip_Memtable& operator=(Skip_Memtable const&) = delete;
+
+  // Flushes the frozen lists, the active list is dropped.
+  ~Skip_Memtable();
+
+  // Returns a copy of the newest element equal to `value` in the active and
+  // frozen lists, if any.
+  std::optional<T> find(T const& value) const;
+
+  // Freezes the active list, if it is not empty, and schedules its flush.
+  // Throws the error that stopped the flusher, if any.
+  void freeze();
+
+  // Inserts `value` in the active list, replacing any equal element there.
+  // Throws the error that stopped the flusher, if any.
+  void insert(T const& value);
+
+  // Returns the paths of the runs written so far, oldest first.
+  std::vector<std::string> runs() const;
+
+  // Returns the approximate number of bytes used by the active list.
+  size_t usage() const;
+
+  // Blocks until every frozen list is written. Throws the error that
+  // stopped the flusher, if any.
+  void wait() const;
+};
+
+#ifdef JHR_SKIP_LIST_POSIX
+// A link of a `Mapped_Skip_List`. Nodes are addressed by their offset from the
+// start of the file so that the file can be mapped anywhere.
+struct Mapped_Link {
+  uint64_t width{0};
+  // Offset of the node, 0 for nullptr
+  uint64_t node{0};
+};
+
+// A node of a `Mapped_Skip_List`, the element is stored inline.
+template <typename T>
+struct Mapped_Node {
+  uint64_t level_;
+  T value_;
+  // Array of `level_` links, the node is allocated with the right size
+  Mapped_Link forward_[1];
+};
+
+// A skip list whose nodes live in a memory mapped file.
+//
+// Links are offsets from the start of the file and elements are stored inline,
+// so the file can be reopened, or opened read-only by several processes, in
+// O(1) without any deserialization: pages are read on demand. The file grows
+// by doubling. Removed nodes are kept in free lists, one per height.
+//
+// Elements must be trivially copyable. Pointers to elements are invalidated
+// when the file grows. The file uses the byte order of the machine.
+template <typename T>
+class Mapped_Skip_List {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "T must be trivially copyable");
+
+ public:
+  enum class Mode { kCreate, kReadWrite, kReadOnly };
+
+ private:
+  using Node = Mapped_Node<T>;
+
+  static constexpr size_t kMaxLevels_{64};
+
+  struct Header {
+    char magic_[8];
+    uint64_t value_size_;
+    uint64_t max_level_;
+    float p_;
+    // Bytes in use, nodes are carved at the end
+    uint64_t size_;
+    uint64_t width_;
+    // Current highest level
+    uint64_t level_;
+    // Offset of the head node, which does not contain any data
+    uint64_t head_;
+    // Removed nodes of every height, linked through their bottom link
+    uint64_t free_[kMaxLevels_];
+  };
+
+  static constexpr char kMagic_[8]{'J', 'H', 'R', 'M', 'A', 'P', '0', '1'};
+
+  int fd_{-1};
+  char* base_{nullptr};
+  size_t capacity_{0};
+  bool read_only_{false};
+
+  std::minstd_rand random_{};
+
+  inline Header* header() const { return reinterpret_cast<Header*>(base_); }
+
+  inline Node* At(uint64_t offset) const {
+    return offset ? reinterpret_cast<Node*>(base_ + offset) : nullptr;
+  }
+
+  // Returns the offset of a new node with `level` links. Can grow and remap
+  // the file, invalidating every pointer in it.
+  uint64_t Allocate(size_t level);
+
+  // Maps `capacity` bytes of the file.
+  void Map(size_t capacity);
+
+  // Returns the size of a node with `level` links.
+  static size_t NodeSize(size_t level);
+
+  // Returns a random level. This level is always smaller than the maximum.
+  size_t RandomLevel();
+
+ public:
+  // Forward iterator over the elements of the list, in order.
+  class iterator {
+   private:
+    Mapped_Skip_List const* list_;
+    Node const* node_;
+
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = T const*;
+    using reference = T const&;
+
+    iterator(Mapped_Skip_List const* list, Node const* node)
+        : list_{list}, node_{node} {}
+
+    reference operator*() const { return node_->value_; }
+    pointer operator->() const { return &node_->value_; }
+
+    iterator& operator++() {
+      node_ = list_->At(node_->forward_[0].node);
+      return *this;
+    }
+    iterator operator++(int) {
+      iterator it{*this};
+      ++*this;
+      return it;
+    }
+
+    bool operator==(iterator const& other) const {
+      return node_ == other.node_;
+    }
+    bool operator!=(iterator const& other) const {
+      return node_ != other.node_;
+    }
+  };
+
+  // Opens the list stored at `path`, or creates it with `kCreate`.
+  // `max_level` and `p` are only used when creating the list.
+  Mapped_Skip_List(std::string const& path, Mode mode, size_t max_level = 16,
+                   float p = 0.5f);
+
+  Mapped_Skip_List(Mapped_Skip_List const&) = delete;
+  Mapped_Skip_List& operator=(Mapped_Skip_List const&) = delete;
+
+  ~Mapped_Skip_List();
+
+  T const& at(size_t index) const;
+  T const& operator[](size_t index) const { return at(index); };
+
+  iterator begin() const {
+    return iterator{this, At(At(header()->head_)->forward_[0].node)};
+  }
+  iterator end() const { return iterator{this, nullptr}; }
+
+  // Returns `true` if the skip list is empty.
+  inline bool empty() const { return length() == 0; }
+
+  // Returns the element equal to `value`, or a null pointer.
+  T const* find(T const& value) const;
+
+  // Writes the modified pages back to the file.
+  void flush();
+
+  // Inserts `value`, replacing any equal element in place. Returns `true` if
+  // the element was not already in the list.
+  bool insert(T const& value);
+
+  // Returns the length of the skip list.
+  inline size_t length() const { return header()->width_; }
+
+  // Removes the element equal to `value`. Returns `true` if there was one.
+  bool remove(T const& value);
+};
+#endif  // JHR_SKIP_LIST_POSIX
+#ifdef JHR_SKIP_LIST_POSIX
+// An append-only log of records with group commit.
+//
+// Appended records are buffered and written by a background thread, which
+// syncs the file every `interval` (or sooner once `kMaxBatch_` bytes are
+// pending or a thread waits for its records), so one sync covers every
+// record appended in the meantime.
+// Every record carries its length and checksum so that a record torn by a
+// crash is detected and dropped on replay.
+class Write_Ahead_Log {
+ private:
+  // Pending bytes that trigger a write without waiting for the interval
+  static constexpr size_t kMaxBatch_{1 << 20};
+
+  int fd_{-1};
+  const std::chrono::milliseconds interval_;
+
+  // Guards everything below
+  std::mutex mutex_;
+  // Wakes the flusher up
+  std::condition_variable pending_;
+  // Wakes up the threads waiting for their records to be durable
+  std::condition_variable durable_;
+
+  // Records appended but not written yet
+  std::string buffer_;
+  // Sequence number of the last appended record
+  uint64_t appended_{0};
+  // Sequence number of the last record synced to the file
+  uint64_t synced_{0};
+  // Number of threads blocked in `wait()`
+  size_t waiting_{0};
+  // Set while the flusher writes a batch without holding the lock
+  bool writing_{false};
+  bool failed_{false};
+  bool stop_{false};
+
+  std::thread flusher_;
+
+  // Returns the checksum of a record.
+  static uint32_t Checksum(uint8_t type, char const* data, size_t size);
+
+  // Writes and syncs the pending records until the log is destroyed.
+  void Flush();
+
+ public:
+  // Opens the log at `path` for appending, creating it if needed.
+  Write_Ahead_Log(std::string const& path, std::chrono::milliseconds interval);
+
+  Write_Ahead_Log(Write_Ahead_Log const&) = delete;
+  Write_Ahead_Log& operator=(Write_Ahead_Log const&) = delete;
+
+  // Syncs the pending records and closes the log.
+  ~Write_Ahead_Log();
+
+  // Appends a record and returns its sequence number. The record is not
+  // durable before `wait()` returns for it. Throws an `std::invalid_argument`
+  // if the payload is larger than 4 GiB.
+  uint64_t append(uint8_t type, char const* data, size_t size);
+
+  // Calls `apply(type, data, size)` on every intact record of the log at
+  // `path` in order, then truncates the log after the last intact record.
+  static void replay(
+      std::string const& path,
+      std::function<void(uint8_t, char const*, size_t)> const& apply);
+
+  // Blocks until every record appended so far is durable.
+  void sync();
+
+  // Drops every record, appended or pending. Used once their effects are
+  // durable elsewhere.
+  void truncate();
+
+  // Blocks until the record `sequence` is durable. Throws an
+  // `std::runtime_error` if the log could not be written.
+  void wait(uint64_t sequence);
+};
+
+// A skip list made durable by a write-ahead log and periodic snapshots.
+//
+// Every `insert()` and `remove()` appends a record to the log before being
+// applied. With `synchronous` writes the call returns once its record is
+// durable; group commit amortizes a single sync over every write made by
+// any thread while the previous sync ran. `checkpoint()` saves a snapshot
+// and empties the log. Opening the list loads the last snapshot and replays
+// the log over it.
+//
+// Elements must be trivially copyable.
+template <typename T>
+class Durable_Skip_List {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "T must be trivially copyable");
+
+ private:
+  enum : uint8_t { kInsert = 1, kRemove = 2 };
+
+  // Guards `list_` and the order of the records in the log
+  mutable std::mutex mutex_;
+
+  Skip_List<T> list_;
+
+  const std::string snapshot_path_;
+  const bool synchronous_;
+
+  std::unique_ptr<Write_Ahead_Log> log_;
+
+ public:
+  Durable_Skip_List(
+      std::string const& snapshot_path, std::string const& log_path,
+      std::chrono::milliseconds interval = std::chrono::milliseconds{10},
+      bool synchronous = true);
+
+  Durable_Skip_List(Durable_Skip_List const&) = delete;
+  Durable_Skip_List& operator=(Durable_Skip_List const&) = delete;
+
+  // Returns a copy of the `index`th element of the list.
+  T at(size_t index) const;
+
+  // Saves a snapshot of the list and empties the log.
+  void checkpoint();
+
+  // Returns `true` if the list is empty.
+  inline bool empty() const { return length() == 0; }
+
+  // Returns a copy of the element equal to `value` if there is one.
+  std::optional<T> find(T const& value) const;
+
+  // Logs and inserts `value`, replacing any equal element. Returns `true` if
+  // the element was not already in the list.
+  bool insert(T const& value);
+
+  // Returns the length of the list.
+  size_t length() const;
+
+  // Logs and removes the element equal to `value`. Returns `true` if there
+  // was one.
+  bool remove(T const& value);
+
+  // Blocks until every write made so far is durable.
+  void sync() { log_->sync(); }
+};
+#endif  // JHR_SKIP_LIST_POSIX
+}  // namespace jhr
+#endif  // JHR_SKIP_LIST_H
+#ifdef JHR_SKIP_LIST_IMPLEMENTATION
+
+inline jhr::internal::Node_Arena::Node_Arena(Node_Arena&& other) noexcept {
+  Take(other);
+}
+
+inline jhr::internal::Node_Arena& jhr::internal::Node_Arena::operator=(
+    Node_Arena&& other) noexcept {
+  if (this != &other) {
+    Release();
+    Take(other);
+  }
+  return *this;
+}
+
+inline void* jhr::internal::Node_Arena::allocate(size_t size,
+                                                 uint32_t* number) {
+  size_t units{Units(size)};
+  if (units < free_.size() && free_[units] != nullptr) {
+    void* block{free_[units]};
+    free_[units] = *static_cast<void**>(block);
+    if (number != nullptr)
+      std::memcpy(number, static_cast<void**>(block) + 1, sizeof(*number));
+    return block;
+  }
+
+  size_t bytes{units * kAlignment_};
+  if (bytes > left_) {
+    size_t chunk_size{
+        chunks_.empty() ? bytes
+                        : std::min(kChunkSize_, 2 * chunks_.back().size)};
+    chunk_size = std::max(chunk_size, bytes);
+    if (huge_pages_) {
+      chunk_size =
+          (bytes + kHugePageSize_ - 1) / kHugePageSize_ * kHugePageSize_;
+    }
+    if (number != nullptr && chunks_.size() >= kMaxChunks_)
+      throw std::overflow_error("SKIP_LIST");
+    void* data{AllocateChunk(chunk_size, huge_pages_)};
+    chunks_.push_back(Chunk{
+        data, chunk_size,
+        std::shared_ptr<void>{data, [chunk_size](void* chunk) {
+                                FreeChunk(chunk, chunk_size);
+                              }}});
+    next_ = static_cast<unsigned char*>(chunks_.back().data);
+    left_ = chunk_size;
+    current_ = chunks_.size() - 1;
+  }
+
+  if (number != nullptr) {
+    size_t offset{static_cast<size_t>(
+        next_ - static_cast<unsigned char*>(chunks_[current_].data))};
+    assert(offset / kAlignment_ < (size_t{1} << kOffsetBits_));
+    *number = static_cast<uint32_t>(current_ << kOffsetBits_ |
+                                    offset / kAlignment_);
+    numbered_ = true;
+  }
+
+  void* block{next_};
+  next_ += bytes;
+  left_ -= bytes;
+  return block;
+}
+
+// Chunks smaller than `kChunkSize_` come from the heap. Huge chunks are
+// first mapped with explicit huge pages, which fails unless the system has
+// some reserved. Otherwise a range one huge page larger is mapped, trimmed
+// to a range aligned on a huge page, and marked for transparent huge pages.
+inline void* jhr::internal::Node_Arena::AllocateChunk(size_t size,
+                                                      bool huge_pages) {
+  if (!huge_pages && size < kChunkSize_) return ::operator new(size);
+#ifdef JHR_SKIP_LIST_POSIX
+  if (!huge_pages) {
+    void* data{::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)};
+    if (data == MAP_FAILED) throw std::bad_alloc{};
+    return data;
+  }
+
+#ifdef MAP_HUGETLB
+  void* data{::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0)};
+  if (data != MAP_FAILED) return data;
+#endif
+
+  size_t mapped{size + kHugePageSize_};
+  void* range{::mmap(nullptr, mapped, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)};
+  if (range == MAP_FAILED) throw std::bad_alloc{};
+
+  uintptr_t begin{reinterpret_cast<uintptr_t>(range)};
+  uintptr_t aligned{(begin + kHugePageSize_ - 1) & ~(kHugePageSize_ - 1)};
+  if (aligned > begin) ::munmap(range, aligned - begin);
+  if (begin + mapped > aligned + size)
+    ::munmap(reinterpret_cast<void*>(aligned + size),
+             begin + mapped - (aligned + size));
+
+#ifdef MADV_HUGEPAGE
+  ::madvise(reinterpret_cast<void*>(aligned), size, MADV_HUGEPAGE);
+#endif
+  return reinterpret_cast<void*>(aligned);
+#else
+  (void)huge_pages;
+  return ::operator new(size);
+#endif
+}
+
+inline size_t jhr::internal::Node_Arena::capacity() const {
+  size_t bytes{0};
+  for (Chunk const& chunk : chunks_) bytes += chunk.size;
+  return bytes;
+}
+
+inline void jhr::internal::Node_Arena::deallocate(void* block, size_t size,
+                                                  uint32_t number) {
+  size_t units{Units(size)};
+  if (units >= free_.size()) free_.resize(units + 1, nullptr);
+  *static_cast<void**>(block) = free_[units];
+  std::memcpy(static_cast<void**>(block) + 1, &number, sizeof(number));
+  free_[units] = block;
+}
+
+// Huge chunks are never smaller than `kChunkSize_`, the size tells how the
+// chunk was allocated.
+inline void jhr::internal::Node_Arena::FreeChunk(void* data, size_t size) {
+#ifdef JHR_SKIP_LIST_POSIX
+  if (size < kChunkSize_)
+    ::operator delete(data);
+  else
+    ::munmap(data, size);
+#else
+  (void)size;
+  ::operator delete(data);
+#endif
+}
+
+// Chunks held by no other arena are freed.
+inline void jhr::internal::Node_Arena::Release() {
+  chunks_.clear();
+  free_.clear();
+  next_ = nullptr;
+  left_ = 0;
+  current_ = 0;
+  numbered_ = false;
+}
+
+// The free blocks and the unused end of the current chunk stay with this
+// arena.
+inline jhr::internal::Node_Arena jhr::internal::Node_Arena::share() const {
+  Node_Arena shared{huge_pages_};
+  shared.numbered_ = numbered_;
+  shared.chunks_ = chunks_;
+  return shared;
+}
+
+// The chunks of `other` the arena does not hold yet are numbered after its
+// chunks, so that lists split by `share()` and concatenated again keep as
+// many chunks as before. Keeps the largest unused end of the two current
+// chunks, the other one is lost.
+inline std::vector<uint32_t> jhr::internal::Node_Arena::splice(
+    Node_Arena& other) {
+  std::vector<std::pair<void const*, uint32_t>> owned;
+  owned.reserve(chunks_.size());
+  for (size_t k = 0; k < chunks_.size(); k++)
+    owned.emplace_back(chunks_[k].owner.get(), static_cast<uint32_t>(k));
+  std::sort(owned.begin(), owned.end());
+
+  std::vector<uint32_t> numbers;
+  numbers.reserve(other.chunks_.size());
+  size_t added{0};
+  for (Chunk const& chunk : other.chunks_) {
+    auto it{std::lower_bound(
+        owned.begin(), owned.end(),
+        std::make_pair(static_cast<void const*>(chunk.owner.get()),
+                       uint32_t{0}))};
+    if (it != owned.end() && it->first == chunk.owner.get()) {
+      numbers.push_back(it->second);
+    } else {
+      numbers.push_back(static_cast<uint32_t>(chunks_.size() + added));
+      added++;
+    }
+  }
+
+  numbered_ = numbered_ || other.numbered_;
+  if (numbered_ && chunks_.size() + added > kMaxChunks_)
+    throw std::overflow_error("SKIP_LIST");
+
+  for (size_t k = 0; k < other.chunks_.size(); k++)
+    if (numbers[k] >= chunks_.size()) chunks_.push_back(other.chunks_[k]);
+
+  if (free_.size() < other.free_.size()) free_.resize(other.free_.size());
+  for (size_t units = 0; units < other.free_.size(); units++) {
+    void* block{other.free_[units]};
+    while (block != nullptr) {
+      void* next{*static_cast<void**>(block)};
+      uint32_t number;
+      std::memcpy(&number, static_cast<void**>(block) + 1, sizeof(number));
+      deallocate(block, units * kAlignment_, renumber(number, numbers));
+      block = next;
+    }
+  }
+
+  if (other.left_ > left_) {
+    next_ = other.next_;
+    left_ = other.left_;
+    current_ = numbers[other.current_];
+  }
+
+  other.chunks_.clear();
+  other.Release();
+  return numbers;
+}
+
+inline void jhr::internal::Node_Arena::Take(Node_Arena& other) noexcept {
+  huge_pages_ = other.huge_pages_;
+  numbered_ = other.numbered_;
+  chunks_.swap(other.chunks_);
+  free_.swap(other.free_);
+  next_ = other.next_;
+  left_ = other.left_;
+  current_ = other.current_;
+
+  other.chunks_.clear();
+  other.free_.clear();
+  other.Release();
+}
+
+
+// Walks to the last node before `low`, then sums links from there, only
+// taking links that end before `high`: it climbs while the link above still
+// does, as a finger search would, then walks down again.
+template <typename T, typename Links>
+auto jhr::Skip_List<T, Links>::aggregate(T const& low, T const& high) const {
+  static_assert(kAugmented_, "SKIP_LIST: aggregates need augment links");
+  typename Monoid::value_type value{Monoid::identity()};
+  if (!(low < high)) return value;
+
+  Skip_Node<T, Links> const* x{head_};
+
+  for (size_t i = level_; i > 0; i--) {
+    while (Next(x, i - 1) != nullptr && *(Next(x, i - 1)->ptr_) < low) {
+      x = Next(x, i - 1);
+    }
+  }
+
+  auto ends_before = [&](size_t i) {
+    return Next(x, i) != nullptr && *(Next(x, i)->ptr_) < high;
+  };
+
+  for (size_t i = 0;;) {
+    if (i + 1 < x->level() && ends_before(i + 1)) {
+      i++;
+    } else if (ends_before(i)) {
+      value = Monoid::combine(std::move(value), Value(x, i));
+      x = Next(x, i);
+    } else if (i > 0) {
+      i--;
+    } else {
+      return value;
+    }
+  }
+}
+
+// Recomputes the aggregate of the link of `x` on level `i`. On the bottom
+// level it is the lifted element linked to, above it combines the links of
+// the level below up to the same node.
+template <typename T, typename Links>
+void jhr::Skip_List<T, Links>::Augment(Skip_Node<T, Links>* x, size_t i) {
+  Skip_Node<T, Links> const* end{Next(x, i)};
+  typename Monoid::value_type value{Monoid::identity()};
+
+  if (end != nullptr && i == 0) {
+    value = Monoid::lift(*end->ptr_);
+  } else if (end != nullptr) {
+    for (Skip_Node<T, Links> const* y = x; y != end; y = Next(y, i - 1))
+      value = Monoid::combine(std::move(value), Value(y, i - 1));
+  }
+  x->forward_[i].value = std::move(value);
+}
+
+// Every level is recomputed from the one below, each link once, in O(n).
+template <typename T, typename Links>
+void jhr::Skip_List<T, Links>::AugmentAll() {
+  for (size_t i = 0; i < level_; i++)
+    for (Skip_Node<T, Links>* x = head_; x != nullptr; x = Next(x, i))
+      Augment(x, i);
+}
+
+template <typename T, typename Links>
+void jhr::Skip_List<T, Links>::AugmentPath(Skip_Node<T, Links>* const* update,
+                                           size_t levels) {
+  for (size_t i = 0; i < levels; i++) Augment(update[i], i);
+}
+
+// Returns the `index`th element of the skip list.
+// If `index` is greater than the width of the skip list throws an
+// `std::overflow_error`.
+template <typename T, typename Links>
+T const& jhr::Skip_List<T, Links>::at(size_t index) const {
+  if (index >= width_) throw std::overflow_error("SKIP_LIST");
+
+  Skip_Node<T, Links> const* x{NodeAt(index)};
+  if (x == nullptr) {
+    DisplayList();
+    throw std::overflow_error("SKIP_LIST");
+  }
+  assert(x->ptr_ != nullptr);
+  return *x->ptr_;
+};
+
+// The path of the previous search holds on every level the last node before
+// its index. The search climbs that path while the next link does not jump
+// past the new index, then descends from there, starting every level from
+// the furthest of the node it came down to and the node of the path.
+template <typename T, typename Links>
+template <typename InputIt, typename OutputIt>
+void jhr::Skip_List<T, Links>::at(InputIt first, InputIt last,
+                                  OutputIt out) const {
+  static_assert(kRanked_, "SKIP_LIST: no_rank links hold no widths");
+
+  std::vector<Skip_Node<T, Links>*> path(level_, head_);
+  std::vector<size_t> path_rank(level_, 0);
+  size_t previous{0};
+
+  for (; first != last; ++first) {
+    size_t index{static_cast<size_t>(*first)};
+    if (index >= width_) throw std::overflow_error("SKIP_LIST");
+    if (index < previous)
+      throw std::invalid_argument("SKIP_LIST: indices are not sorted");
+    previous = index;
+
+    // The rank of the node at `index`
+    size_t w{index + 1};
+
+    size_t top{0};
+    while (top + 1 < level_ && Next(path[top], top) != nullptr &&
+           path_rank[top] + Width(path[top], top) <= w)
+      top++;
+
+    Skip_Node<T, Links>* x{path[top]};
+    size_t rank{path_rank[top]};
+
+    for (size_t i = top + 1; i > 0; i--) {
+      if (path_rank[i - 1] > rank) {
+        x = path[i - 1];
+        rank = path_rank[i - 1];
+      }
+      while (Next(x, i - 1) != nullptr && rank + Width(x, i - 1) <= w) {
+        rank += Width(x, i - 1);
+        x = Next(x, i - 1);
+      }
+      path[i - 1] = x;
+      path_rank[i - 1] = rank;
+    }
+
+    *out++ = *x->ptr_;
+  }
+}
+
+template <typename T, typename Links>
+jhr::Skip_Node<T, Links>* jhr::Skip_List<T, Links>::Bound(T const& value,
+                                                          bool upper,
+                                                          size_t* rank) const {
+  Skip_Node<T, Links>* x{head_};
+
+  for (size_t i = level_; i > 0; i--) {
+    while (Next(x, i - 1) != nullptr &&
+           (upper ? !(value < *(Next(x, i - 1)->ptr_))
+                  : *(Next(x, i - 1)->ptr_) < value)) {
+      if constexpr (kRanked_)
+        if (rank) *rank += Width(x, i - 1);
+      x = Next(x, i - 1);
+    }
+  }
+  return x;
+}
+
+// Replaces the content of the list with the sorted range [first, last).
+// Runs of equal elements are collapsed to their last element, as repeated
+// calls to `insert()` would. The range is split in chunks whose nodes are
+// created on their own thread, then the chunks are linked together. No
+// comparison other than `==` between neighbours is made.
+template <typename T, typename Links>
+template <typename RandomIt>
+void jhr::Skip_List<T, Links>::build(RandomIt first, RandomIt last,
+                                     size_t threads) {
+  clear();
+
+  size_t n{static_cast<size_t>(last - first)};
+  CheckLength(n);
+  size_t chunks{Chunks(n, threads)};
+
+  // Every thread draws its levels from its own engine
+  std::vector<std::minstd_rand::result_type> seeds(chunks);
+  for (auto& seed : seeds) seed = random_();
+
+  // and creates its nodes in its own arena
+  std::vector<std::vector<Skip_Node<T, Links>*>> nodes(chunks);
+  std::vector<internal::Node_Arena> arenas{Arenas(chunks)};
+
+  RunParallel(chunks, [&](size_t chunk) {
+    std::minstd_rand random{seeds[chunk]};
+    size_t begin{n * chunk / chunks};
+    size_t end{n * (chunk + 1) / chunks};
+
+    nodes[chunk].reserve(end - begin);
+    for (size_t k = begin; k < end; k++) {
+      if (k + 1 < n && first[k] == first[k + 1]) continue;
+      nodes[chunk].push_back(CreateNode(arenas[chunk], new T{first[k]},
+                                        RandomLevel(random)));
+    }
+  });
+
+  for (size_t chunk = 0; chunk < chunks; chunk++) {
+    std::vector<uint32_t> numbers{arena_.splice(arenas[chunk])};
+    if constexpr (kNumbered_)
+      for (Skip_Node<T, Links>* node : nodes[chunk])
+        node->number_ = internal::Node_Arena::renumber(node->number_, numbers);
+  }
+  Link(nodes);
+}
+
+// Centers a string by padding it left and right with spaces.
+template <typename T, typename Links>
+inline std::string jhr::Skip_List<T, Links>::CenterString(const std::string& s,
+                                                          size_t width) {
+  std::string r = std::string((width - 1) / 2 - s.length() / 2, ' ');
+  r = r + s;
+  r.resize(width, ' ');
+  return r;
+};
+// Returns the number of chunks an input of `n` elements should be split in
+// when using at most `threads` threads (0 for one per core).
+template <typename T, typename Links>
+size_t jhr::Skip_List<T, Links>::Chunks(size_t n, size_t threads) {
+  if (threads == 0)
+    threads = std::max(1U, std::thread::hardware_concurrency());
+  return std::max<size_t>(1, std::min(threads, n / kParallelGrain_));
+}
+
+// Removes and deletes every element of the skip list.
+template <typename T, typename Links>
+void jhr::Skip_List<T, Links>::clear() {
+  Skip_Node<T, Links>* node = Next(head_, 0);
+  while (node) {
+    delete node->ptr_;
+    node = Next(node, 0);
+  }
+
+  // Frees every node at once
+  Reset();
+}
+
+// Copies the nodes in order into a new arena, every node being linked from
+// the last copied node of every level it belongs to. The old arena is then
+// freed as a whole.
+template <typename T, typename Links>
+void jhr::Skip_List<T, Links>::compact() {
+  internal::Node_Arena arena{arena_.huge_pages()};
+  Skip_Node<T, Links>* head{CreateNode(arena, nullptr, kMaxLevel_)};
+  for (size_t i = 0; i < kMaxLevel_; i++) {
+    if constexpr (kRanked_) SetWidth(head, i, Width(head_, i));
+    if constexpr (kAugmented_) head->forward_[i].value = Value(head_, i);
+  }
+
+  std::vector<Skip_Node<T, Links>*> last(kMaxLevel_, head);
+  for (Skip_Node<T, Links> const* x = Next(head_, 0); x != nullptr;
+       x = Next(x, 0)) {
+    Skip_Node<T, Links>* copy{CreateNode(arena, x->ptr_, x->level())};
+    for (size_t i = 0; i < x->level(); i++) {
+      if constexpr (kRanked_) SetWidth(copy, i, Width(x, i));
+      if constexpr (kAugmented_) copy->forward_[i].value = Value(x, i);
+      SetNext(last[i], i, copy);
+      last[i] = copy;
+    }
+  }
+
+  arena_ = std::move(arena);
+  head_ = head;
+
+  // Points the head back to the last node of every level
+  if constexpr (kBackLinked_)
+    for (size_t i = 0; i < kMaxLevel_; i++) SetNext(last[i], i, nullptr);
+}
+
+// Finds the last node of every level, then links the first node of every
+// level of `other` after it. The head of `other` is given back to the arena,
+// which takes over the arena of `other`.
+template <typename T, typename Links>
+void jhr::Skip_List<T, Links>::concat(Skip_List& other) {
+  if (other.empty()) return;
+  if (other.level_ > kMaxLevel_)
+    throw std::invalid_argument("SKIP_LIST: list is too high to concat");
+
+  std::vector<Skip_Node<T, Links>*> tail(kMaxLevel_, head_);
+  std::vector<size_t> tail_rank(kMaxLevel_, 0);
+
+  Skip_Node<T, Links>* x{head_};
+  size_t rank{0};
+
+  for (size_t i = level_; i > 0; i--) {
+    while (Next(x, i - 1) != nullptr) {
+      if constexpr (kRanked_) rank += Width(x, i - 1);
+      x = Next(x, i - 1);
+    }
+    tail[i - 1] = x;
+    tail_rank[i - 1] = rank;
+  }
+
+  if (!empty() && !(*tail[0]->ptr_ < *other.Next(other.head_, 0)->ptr_))
+    throw std::invalid_argument("SKIP_LIST: lists overlap");
+  CheckLength(width_ + other.width_);
+
+  Skip_Node<T, Links>* other_head{other.head_};
+  std::vector<uint32_t> numbers{arena_.splice(other.arena_)};
+
+  // The links of `other` hold numbers in its own arena
+  if constexpr (kNumbered_) {
+    for (Skip_Node<T, Links>* y = other_head; y != nullptr; y = Next(y, 0)) {
+      y->number_ = internal::Node_Arena::renumber(y->number_, numbers);
+      for (size_t i = 0; i < y->level(); i++)
+        if (y->forward_[i].node != 0)
+          y->forward_[i].node =
+              internal::Node_Arena::renumber(y->forward_[i].node, numbers);
+    }
+  }
+
+  for (size_t i = 0; i < other.level_; i++) {
+    Skip_Node<T, Links>* first{Next(other_head, i)};
+    if (first == nullptr) continue;
+    SetNext(tail[i], i, first);
+    if constexpr (kBackLinked_) head_->forward_[i].prev = other.Tail(i);
+    if constexpr (kRanked_)
+      SetWidth(tail[i], i, width_ + Width(other_head, i) - tail_rank[i]);
+  }
+
+  level_ = std::max(level_, other.level_);
+  width_ += other.width_;
+  if constexpr (kAugmented_) AugmentPath(tail.data(), level_);
+
+  DeleteNode(other_head);
+  other.Reset();
+}
+
+// Draws a visual representation of the skip list.
+// A link to a node is represented by an arrow (`o-->`) and final elements of
+// a level, that point to a null pointer, are represented by an `x`.
+template <typename T, typename Links>
+void jhr::Skip_List<T, Links>::DisplayList() const {
+  static_assert(kRanked_, "SKIP_LIST: no_rank links hold no widths");
+  // Example result, heavily inspired by wikipedia's illustrations on skip
+  // lists
+  //            4
+  // o---------------------> x Level 2
+  //   1     1        2
+  // o---> o---> o---------> x Level 1
+  //   1     1     1     1     1     1
+  // o---> o---> o---> o---> o---> o---> Level 0
+  //       3     6     7     9     12
+
+  for (size_t i = level_; i > 0; i--) {
+    Skip_Node<T, Links>* node = head_;
+
+    // Draws the width labels
+    while (node != nullptr) {
+      if (Width(node, i - 1) > 0)
+        std::cout << CenterString(std::to_string(Width(node, i - 1)),
+                                  Width(node, i - 1) * 6);
+
+      node = Next(node, i - 1);
+    }
+
+    std::cout << std::endl;
+
+    // Draws the arrows
+    node = head_;
+    while (node != nullptr) {
+      if (Width(node, i - 1) > 0)
+        std::cout << "o"
+                  << std::string(Width(node, i - 1) * 6 - 3, '-')
+                  << "> ";
+      else
+        std::cout << "x ";
+      node = Next(node, i - 1);
+    }
+
+    std::cout << "Level " << i - 1 << std::endl;
+  }
+
+// Draws the node labels
+#if 0
+  Skip_Node<T, Links>* node = head_;
+  while (node != nullptr) {
+    if (node->ptr_ != nullptr) {
+      std::cout << std::to_string(*node->ptr_)
+                << std::string(6 - std::to_string(*node->ptr_).length(), ' ');
+    } else {
+      std::cout << std::string(6, ' ');
+    }
+    node = Next(node, 0);
+  }
+#endif
+}
+
+template <typename T, typename Links>
+template <typename... Args>
+std::pair<typename jhr::Skip_List<T, Links>::iterator, T const*>
+jhr::Skip_List<T, Links>::emplace(Args&&... args) {
+  std::unique_ptr<T const> data{new T{std::forward<Args>(args)...}};
+  std::pair<Skip_Node<T, Links>*, T const*> inserted{
+      InsertNode(data.get(), RandomLevel())};
+  data.release();
+  return {iterator{this, inserted.first}, inserted.second};
+}
+
+// Finds the last node before `low` on every level, then walks on from there
+// to the last node before `high`, or the last node not greater than `high`.
+template <typename T, typename Links>
+size_t jhr::Skip_List<T, Links>::EraseRange(T const& low, T const& high,
+                                            bool closed) {
+  if (closed ? high < low : !(low < high)) return 0;
+
+  std::vector<Skip_Node<T, Links>*> before(level_), last(level_);
+  std::vector<size_t> before_rank(level_), last_rank(level_);
+
+  Skip_Node<T, Links>* x{head_};
+  size_t rank{0};
+
+  for (size_t i = level_; i > 0; i--) {
+    while (Next(x, i - 1) != nullptr && *(Next(x, i - 1)->ptr_) < low) {
+      if constexpr (kRanked_) rank += Width(x, i - 1);
+      x = Next(x, i - 1);
+    }
+    before[i - 1] = x;
+    before_rank[i - 1] = rank;
+  }
+
+  x = before[level_ - 1];
+  rank = before_rank[level_ - 1];
+
+  for (size_t i = level_; i > 0; i--) {
+    while (Next(x, i - 1) != nullptr &&
+           (closed ? !(high < *(Next(x, i - 1)->ptr_))
+                   : *(Next(x, i - 1)->ptr_) < high)) {
+      if constexpr (kRanked_) rank += Width(x, i - 1);
+      x = Next(x, i - 1);
+    }
+    last[i - 1] = x;
+    last_rank[i - 1] = rank;
+  }
+
+  return EraseSpan(before.data(), before_rank.data(), last.data(),
+                   last_rank.data());
+}
+
+// Uses the widths to find both ends of the span, no comparison is made.
+template <typename T, typename Links>
+size_t jhr::Skip_List<T, Links>::erase_at(size_t first, size_t last) {
+  static_assert(kRanked_, "SKIP_LIST: no_rank links hold no widths");
+  if (first > last || last > width_) throw std::overflow_error("SKIP_LIST");
+  if (first == last) return 0;
+
+  std::vector<Skip_Node<T, Links>*> before(level_), end(level_);
+  std::vector<size_t> before_rank(level_), end_rank(level_);
+
+  Skip_Node<T, Links>* x{head_};
+  size_t rank{0};
+
+  for (size_t i = level_; i > 0; i--) {
+    while (Next(x, i - 1) != nullptr && rank + Width(x, i - 1) <= first) {
+      rank += Width(x, i - 1);
+      x = Next(x, i - 1);
+    }
+    before[i - 1] = x;
+    before_rank[i - 1] = rank;
+  }
+
+  x = before[level_ - 1];
+  rank = before_rank[level_ - 1];
+
+  for (size_t i = level_; i > 0; i--) {
+    while (Next(x, i - 1) != nullptr && rank + Width(x, i - 1) <= last) {
+      rank += Width(x, i - 1);
+      x = Next(x, i - 1);
+    }
+    end[i - 1] = x;
+    end_rank[i - 1] = rank;
+  }
+
+  return EraseSpan(before.data(), before_rank.data(), end.data(),
+                   end_rank.data());
+}
+
+// Every level is relinked over the span once. A link from before the span
+// to after it loses the width of the span, the nodes themselves are then
+// freed in a single walk of the bottom level. Erasing every element clears
+// the list, freeing its memory at once.
+template <typename T, typename Links>
+size_t jhr::Skip_List<T, Links>::EraseSpan(Skip_Node<T, Links>* const* before,
+                                           size_t const* before_rank,
+                                           Skip_Node<T, Links>* const* last,
+                                           size_t const* last_rank) {
+  if (before[0] == last[0]) return 0;
+
+  Skip_Node<T, Links>* x{Next(before[0], 0)};
+  Skip_Node<T, Links>* end{Next(last[0], 0)};
+
+  if (before[0] == head_ && end == nullptr) {
+    size_t count{width_};
+    clear();
+    return count;
+  }
+
+  // Number of nodes in the span
+  size_t span{last_rank[0] - before_rank[0]};
+
+  for (size_t i = 0; i < level_; i++) {
+    if (before[i] == last[i]) {
+      // The link jumps over the whole span, the width to nullptr is always 0
+      if constexpr (kRanked_)
+        if (Next(before[i], i))
+          SetWidth(before[i], i, Width(before[i], i) - span);
+      continue;
+    }
+
+    Skip_Node<T, Links>* next{Next(last[i], i)};
+    if constexpr (kRanked_) {
+      if (next)
+        SetWidth(before[i], i,
+                 last_rank[i] + Width(last[i], i) - before_rank[i] - span);
+      else
+        SetWidth(before[i], i, i == 0 ? 1 : 0);
+    }
+    SetNext(before[i], i, next);
+  }
+
+  if constexpr (kAugmented_) AugmentPath(before, level_);
+
+  // Updates the list's max level
+  while (level_ > 1 && Next(head_, level_ - 1) == nullptr) level_--;
+
+  size_t count{0};
+  while (x != end) {
+    Skip_Node<T, Links>* next{Next(x, 0)};
+    delete x->ptr_;
+    DeleteNode(x);
+    x = next;
+    count++;
+  }
+
+  width_ -= count;
+  return count;
+}
+
+template <typename T, typename Links>
+typename jhr::Skip_List<T, Links>::iterator jhr::Skip_List<T, Links>::erase(
+    iterator position) {
+  Skip_Node<T, Links>* x{const_cast<Skip_Node<T, Links>*>(position.node_)};
+  iterator next{this, Next(x, 0)};
+
+  std::unique_ptr<Skip_Node<T, Links>* []> update {
+    new jhr::Skip_Node<T, Links>* [level_] {}
+  };
+  Predecessors(x, update.get());
+  delete Unlink(update.get(), x);
+  return next;
+}
+
+template <typename T, typename Links>
+typename jhr::Skip_List<T, Links>::node_handle
+jhr::Skip_List<T, Links>::extract(T const& value) {
+  std::unique_ptr<Skip_Node<T, Links>* []> update {
+    new jhr::Skip_Node<T, Links>* [level_] {}
+  };
+
+  Skip_Node<T, Links>* x{head_};
+
+  for (size_t i = level_; i > 0; i--) {
+    while (Next(x, i - 1) != nullptr && *(Next(x, i - 1)->ptr_) < value) {
+      x = Next(x, i - 1);
+    }
+    update[i - 1] = x;
+  }
+
+  x = Next(x, 0);
+  if (x == nullptr || !(*(x->ptr_) == value)) return node_handle{};
+
+  size_t level{x->level()};
+  return node_handle{Unlink(update.get(), x), level};
+}
+
+template <typename T, typename Links>
+typename jhr::Skip_List<T, Links>::node_handle
+jhr::Skip_List<T, Links>::extract(iterator position) {
+  Skip_Node<T, Links>* x{const_cast<Skip_Node<T, Links>*>(position.node_)};
+
+  std::unique_ptr<Skip_Node<T, Links>* []> update {
+    new jhr::Skip_Node<T, Links>* [level_] {}
+  };
+  Predecessors(x, update.get());
+
+  size_t level{x->level()};
+  return node_handle{Unlink(update.get(), x), level};
+}
+
+// Calls `function(chunk, node, count)` for `chunks` slices of the index range
+// [first, last) of equal length, each one on its own thread. `node` is the
+// first node of the slice and `count` its number of nodes.
+template <typename T, typename Links>
+template <typename Function>
+void jhr::Skip_List<T, Links>::ForEachChunk(size_t first, size_t last,
+                                            size_t chunks,
+                                            Function const& function) const {
+  size_t n{last - first};
+  RunParallel(chunks, [&](size_t chunk) {
+    size_t begin{first + n * chunk / chunks};
+    size_t end{first + n * (chunk + 1) / chunks};
+    function(chunk, begin < end ? NodeAt(begin) : nullptr, end - begin);
+  });
+}
+
+// Returns the node associated with `ptr` if it exist.
+// If `ptr` is not in the skip list it returns a null pointer.
+template <typename T, typename Links>
+T const* jhr::Skip_List<T, Links>::find(T const& ptr) const {
+  jhr::Skip_Node<T, Links>* x{head_};
+
+  for (size_t i = level_; i > 0; i--) {
+    while (Next(x, i - 1) != nullptr && *(Next(x, i - 1)->ptr_) < ptr) {
+      x = Next(x, i - 1);
+    }
+  }
+  x = Next(x, 0);
+  if (x != nullptr && *(x->ptr_) == ptr) return x->ptr_;
+
+  return nullptr;
+};
+
+template <typename T, typename Links>
+jhr::Frozen_Skip_List<T> jhr::Skip_List<T, Links>::freeze() const {
+  std::vector<T> values;
+  values.reserve(width_);
+  for (T const& value : *this) values.push_back(value);
+  return Frozen_Skip_List<T>{std::move(values)};
+}
+
+// Inserts a new element in the skip list returns a pointer to the newly
+// created node. If the element was already in the skip list, updates the data
+// and returns the previously stored data
+template <typename T, typename Links>
+T const* jhr::Skip_List<T, Links>::insert(T const& ptr) {
+  std::unique_ptr<T const> data{new T{ptr}};
+  T const* old_data{InsertNode(data.get(), RandomLevel()).second};
+  data.release();
+  return old_data;
+}
+
+template <typename T, typename Links>
+std::pair<typename jhr::Skip_List<T, Links>::iterator, T const*>
+jhr::Skip_List<T, Links>::insert(node_handle&& node) {
+  if (node.empty()) return {end(), nullptr};
+
+  std::pair<Skip_Node<T, Links>*, T const*> inserted{
+      InsertNode(node.ptr_, node.level_)};
+  node.ptr_ = nullptr;
+  return {iterator{this, inserted.first}, inserted.second};
+}
+
+// Links the element `ptr` in a tower of height `level`, or in place of the
+// data of the node holding an equal element. Returns the node and the data
+// it replaced. The list only takes `ptr` over if no exception is thrown.
+template <typename T, typename Links>
+template <bool kReplace>
+std::pair<jhr::Skip_Node<T, Links>*, T const*>
+jhr::Skip_List<T, Links>::InsertNode(T const* ptr, size_t level) {
+  // Array of pointers to elements that will need updating
+  std::unique_ptr<Skip_Node<T, Links>* []> update {
+    new Skip_Node<T, Links>* [kMaxLevel_] {}
+  };
+
+  std::unique_ptr<size_t[]> update_width{
+      kRanked_ ? new size_t[kMaxLevel_]{} : nullptr};
+
+  Skip_Node<T, Links>* x{head_};
+
+  for (size_t i = level_; i > 0; i--) {
+    // The sum of traveled widths
+    size_t width_sum{0};
+
+    while (Next(x, i - 1) != nullptr &&
+           (kReplace ? *(Next(x, i - 1)->ptr_) < *ptr
+                     : !(*ptr < *(Next(x, i - 1)->ptr_)))) {
+      if constexpr (kRanked_) width_sum += Width(x, i - 1);
+      x = Next(x, i - 1);
+    }
+
+    update[i - 1] = x;
+    if constexpr (kRanked_) update_width[i - 1] = width_sum;
+  }
+
+  // Towers taken from a higher list are cut down
+  level = std::min(level, kMaxLevel_);
+
+  // Complete the update list with the head of the list
+  // if the new node is the first node on a new levels
+  if (level > level_) {
+    for (size_t i = level_; i < level; i++) {
+      update[i] = head_;
+
+      // For simplicity, the width to nullptr is always 0
+      SetWidth(head_, i, 0);
+    }
+    level_ = level;
+  }
+
+  // If the node is already in the list retuns the already existing node
+  if constexpr (kReplace)
+    if (Next(x, 0) != nullptr && *(Next(x, 0)->ptr_) == *ptr) {
+      T const* old_data = Next(x, 0)->ptr_;
+      Next(x, 0)->ptr_ = ptr;
+      if constexpr (kAugmented_) AugmentPath(update.get(), level_);
+      return {Next(x, 0), old_data};
+    }
+
+  CheckLength(width_ + 1);
+  Skip_Node<T, Links>* new_node = CreateNode(ptr, level);
+
+  for (size_t i = 0; i < level; i++) {
+    // Update the linked nodes
+    SetNext(new_node, i, Next(update[i], i));
+    SetNext(update[i], i, new_node);
+
+    // updates the widths of the links
+    if constexpr (kRanked_) {
+      if (i > 0) {
+        size_t width_before{update_width[i - 1] +
+                            Width(update[i - 1], i - 1)};
+
+        if (Width(update[i], i) > 0)
+          // The width is the width of the previous connection,
+          // + 1 ( because we are inserting a node )
+          // - whatever is before the new node
+          SetWidth(new_node, i, Width(update[i], i) + 1 - width_before);
+        else
+          // For simplicity, the width to nullptr is always 0
+          SetWidth(new_node, i, 0);
+
+        SetWidth(update[i], i, width_before);
+      }
+    }
+  }
+
+  /* Updates the widths of the links above the newly created node. */
+  if constexpr (kRanked_) {
+    for (size_t i = level; i < level_; ++i) {
+      if (Next(update[i], i))
+        SetWidth(update[i], i, Width(update[i], i) + 1);
+      else
+        /* The width to NULL is always 0 and does not need updating. All
+         * links above a link pointing to NULL will point to NULL. */
+        break;
+    }
+  }
+
+  // The new node spans the rest of the links of its predecessors
+  if constexpr (kAugmented_) {
+    for (size_t i = 0; i < level_; i++) {
+      if (i < level) Augment(new_node, i);
+      Augment(update[i], i);
+    }
+  }
+
+  width_++;
+
+  return {new_node, nullptr};
+}
+
+// Inserts the unsorted range [first, last) in the skip list, replacing the
+// data of equal elements. The replaced data is deleted.
+// The batch is sorted in parallel chunks merged pairwise. Batches that are
+// small compared to the list are then inserted one by one, larger ones are
+// merged with the nodes of the list in parallel, every chunk of the batch
+// taking the nodes in its key range, and the whole list is relinked.
+template <typename T, typename Links>
+template <typename InputIt>
+void jhr::Skip_List<T, Links>::insert_bulk(InputIt first, InputIt last,
+                                           size_t threads) {
+  std::vector<T> batch(first, last);
+  size_t m{batch.size()};
+  if (m == 0) return;
+  CheckLength(width_ + m);
+
+  size_t chunks{Chunks(m, threads)};
+  std::vector<size_t> bounds(chunks + 1);
+  for (size_t chunk = 0; chunk <= chunks; chunk++)
+    bounds[chunk] = m * chunk / chunks;
+
+  // A stable sort keeps equal elements in order, the last one wins
+  RunParallel(chunks, [&](size_t chunk) {
+    std::stable_sort(batch.begin() + bounds[chunk],
+                     batch.begin() + bounds[chunk + 1]);
+  });
+  for (size_t step = 1; step < chunks; step *= 2) {
+    RunParallel((chunks + 2 * step - 1) / (2 * step), [&](size_t pair) {
+      size_t low{2 * step * pair};
+      size_t middle{std::min(low + step, chunks)};
+      size_t high{std::min(low + 2 * step, chunks)};
+      std::inplace_merge(batch.begin() + bounds[low],
+                         batch.begin() + bounds[middle],
+                         batch.begin() + bounds[high]);
+    });
+  }
+
+  if (empty()) return build(batch.begin(), batch.end(), threads);
+
+  if (m * level_ < width_) {
+    for (size_t k = 0; k < m; k++)
+      if (k + 1 == m || !(batch[k] == batch[k + 1])) delete insert(batch[k]);
+    return;
+  }
+
+  // The nodes already in the list, in order
+  std::vector<Skip_Node<T, Links>*> existing;
+  existing.reserve(width_);
+  for (Skip_Node<T, Links>* x = Next(head_, 0); x; x = Next(x, 0))
+    existing.push_back(x);
+
+  // `splits[chunk]` is the first existing node merged by `chunk`
+  std::vector<size_t> splits(chunks + 1);
+  splits[0] = 0;
+  splits[chunks] = existing.size();
+  for (size_t chunk = 1; chunk < chunks; chunk++) {
+    splits[chunk] = static_cast<size_t>(
+        std::lower_bound(existing.begin(), existing.end(), batch[bounds[chunk]],
+                         [](Skip_Node<T, Links> const* node, T const& value) {
+                           return *node->ptr_ < value;
+                         }) -
+        existing.begin());
+  }
+
+  std::vector<std::minstd_rand::result_type> seeds(chunks);
+  for (auto& seed : seeds) seed = random_();
+
+  std::vector<std::vector<Skip_Node<T, Links>*>> nodes(chunks);
+  std::vector<std::vector<Skip_Node<T, Links>*>> created(chunks);
+  std::vector<internal::Node_Arena> arenas{Arenas(chunks)};
+
+  RunParallel(chunks, [&](size_t chunk) {
+    std::minstd_rand random{seeds[chunk]};
+    std::vector<Skip_Node<T, Links>*>& merged{nodes[chunk]};
+    merged.reserve(bounds[chunk + 1] - bounds[chunk] + splits[chunk + 1] -
+                   splits[chunk]);
+
+    size_t o{splits[chunk]};
+    for (size_t k = bounds[chunk]; k < bounds[chunk + 1]; k++) {
+      if (k + 1 < m && batch[k] == batch[k + 1]) continue;
+
+      while (o < splits[chunk + 1] && *existing[o]->ptr_ < batch[k])
+        merged.push_back(existing[o++]);
+
+      if (o < splits[chunk + 1] && *existing[o]->ptr_ == batch[k]) {
+        delete existing[o]->ptr_;
+        existing[o]->ptr_ = new T{batch[k]};
+        merged.push_back(existing[o++]);
+      } else {
+        merged.push_back(CreateNode(arenas[chunk], new T{batch[k]},
+                                    RandomLevel(random)));
+        if (kNumbered_) created[chunk].push_back(merged.back());
+      }
+    }
+    while (o < splits[chunk + 1]) merged.push_back(existing[o++]);
+  });
+
+  for (size_t chunk = 0; chunk < chunks; chunk++) {
+    std::vector<uint32_t> numbers{arena_.splice(arenas[chunk])};
+    for (Skip_Node<T, Links>* node : created[chunk])
+      node->number_ = internal::Node_Arena::renumber(node->number_, numbers);
+  }
+  Link(nodes);
+}
+
+// Replaces the content of the list with a snapshot written by `save()` with
+// trivially copyable elements.
+template <typename T, typename Links>
+void jhr::Skip_List<T, Links>::load(std::istream& in) {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "T must be trivially copyable, pass a reader to load()");
+  load(in, [](std::istream& records) {
+    return internal::ReadPod<T>(records);
+  });
+}
+
+// Replaces the content of the list with the snapshot stored at `path`.
+template <typename T, typename Links>
+void jhr::Skip_List<T, Links>::load(std::string const& path) {
+  std::ifstream in{path, std::ios::binary};
+  if (!in) throw std::runtime_error("SKIP_LIST: cannot open " + path);
+  load(in);
+}
+
+// Replaces the content of the list with a snapshot written by `save()`,
+// reading the elements with `read(in)`.
+// The nodes are rebuilt in one pass in the order of the snapshot, each one
+// linked after the last node seen on every level of its tower, so no
+// comparison or search is made. The widths are read from the snapshot when
+// it holds them, and are otherwise the differences between the ranks of the
+// linked nodes. Throws an `std::runtime_error` and leaves the list empty if
+// the snapshot is truncated, does not fit this list or does not match its
+// checksum.
+template <typename T, typename Links>
+template <typename Reader>
+void jhr::Skip_List<T, Links>::load(std::istream& in, Reader const& read) {
+  clear();
+
+  char magic[sizeof(kMagic_)];
+  in.read(magic, sizeof(magic));
+  if (!in || std::memcmp(magic, kMagic_, sizeof(kMagic_)) != 0)
+    throw std::runtime_error("SKIP_LIST: not a skip list snapshot");
+
+  // Everything but the magic and the checksum itself is checksummed
+  internal::Checksum_Buffer hashing{in.rdbuf()};
+  std::istream records{&hashing};
+
+  uint32_t flags{internal::ReadPod<uint32_t>(records)};
+  uint64_t count{internal::ReadPod<uint64_t>(records)};
+  uint64_t level{internal::ReadPod<uint64_t>(records)};
+  uint64_t checksum{internal::ReadPod<uint64_t>(in)};
+  bool widths{(flags & kWidthsFlag_) != 0};
+
+  if (!records || !in || level == 0 || level > kMaxLevel_)
+    throw std::runtime_error("SKIP_LIST: invalid snapshot header");
+  CheckLength(count);
+
+  try {
+    if (widths)
+      for (size_t i = 0; i < level; i++)
+        SetWidth(head_, i, internal::ReadPod<uint64_t>(records));
+
+    // Last node seen on every level, with its rank
+    std::vector<Skip_Node<T, Links>*> last(kMaxLevel_, head_);
+    std::vector<size_t> last_rank(kMaxLevel_, 0);
+
+    for (size_t rank = 1; rank <= count; rank++) {
+      size_t height{internal::ReadPod<uint8_t>(records)};
+      if (!records || height == 0 || height > level)
+        throw std::runtime_error("SKIP_LIST: invalid snapshot record");
+
+      std::unique_ptr<size_t[]> node_widths{new size_t[height]};
+      if (widths)
+        for (size_t i = 0; i < height; i++)
+          node_widths[i] = internal::ReadPod<uint64_t>(records);
+
+      Skip_Node<T, Links>* node{CreateNode(new T{read(records)}, height)};
+      for (size_t i = 0; i < height; i++) {
+        SetNext(last[i], i, node);
+        if (widths)
+          SetWidth(node, i, node_widths[i]);
+        else
+          SetWidth(last[i], i, rank - last_rank[i]);
+        last[i] = node;
+        last_rank[i] = rank;
+      }
+      width_ = rank;
+
+      if (!records)
+        throw std::runtime_error("SKIP_LIST: truncated snapshot");
+    }
+
+    // For simplicity, the width to nullptr is always 0 (1 on the bottom
+    // level)
+    if (!widths)
+      for (size_t i = 0; i < kMaxLevel_; i++)
+        SetWidth(last[i], i, i == 0 ? 1 : 0);
+
+    // Points the head back to the last node of every level
+    if constexpr (kBackLinked_)
+      for (size_t i = 0; i < kMaxLevel_; i++) SetNext(last[i], i, nullptr);
+
+    level_ = level;
+    if (hashing.checksum() != checksum)
+      throw std::runtime_error("SKIP_LIST: snapshot checksum mismatch");
+    if constexpr (kAugmented_) AugmentAll();
+  } catch (...) {
+    clear();
+    throw;
+  }
+}
+
+// Relinks every level of the list over `chunks`, which hold all the nodes of
+// the list in order. Every chunk is linked on its own thread, remembering the
+// first and last node of each of its levels, then consecutive chunks are
+// stitched together level by level. Widths are the differences between the
+// ranks of linked nodes.
+template <typename T, typename Links>
+void jhr::Skip_List<T, Links>::Link(
+    std::vector<std::vector<Skip_Node<T, Links>*>> const& chunks) {
+  struct Tower_End {
+    size_t rank{0};
+    Skip_Node<T, Links>* node{nullptr};
+  };
+
+  // Rank of the node before the first node of every chunk
+  std::vector<size_t> offsets(chunks.size() + 1, 0);
+  for (size_t chunk = 0; chunk < chunks.size(); chunk++)
+    offsets[chunk + 1] = offsets[chunk] + chunks[chunk].size();
+
+  std::vector<std::vector<Tower_End>> firsts(
+      chunks.size(), std::vector<Tower_End>(kMaxLevel_));
+  std::vector<std::vector<Tower_End>> lasts(
+      chunks.size(), std::vector<Tower_End>(kMaxLevel_));
+  std::vector<size_t> levels(chunks.size(), 1);
+
+  RunParallel(chunks.size(), [&](size_t chunk) {
+    std::vector<Tower_End>& first{firsts[chunk]};
+    std::vector<Tower_End>& last{lasts[chunk]};
+    size_t rank{offsets[chunk]};
+
+    for (Skip_Node<T, Links>* node : chunks[chunk]) {
+      rank++;
+      for (size_t i = 0; i < node->level(); i++) {
+        if (last[i].node) {
+          SetNext(last[i].node, i, node);
+          SetWidth(last[i].node, i, rank - last[i].rank);
+        } else {
+          first[i] = {rank, node};
+        }
+        last[i] = {rank, node};
+      }
+      levels[chunk] = std::max(levels[chunk], node->level());
+    }
+  });
+
+  std::vector<Tower_End> tail(kMaxLevel_, Tower_End{0, head_});
+  for (size_t chunk = 0; chunk < chunks.size(); chunk++) {
+    for (size_t i = 0; i < levels[chunk]; i++) {
+      if (!firsts[chunk][i].node) continue;
+      SetNext(tail[i].node, i, firsts[chunk][i].node);
+      SetWidth(tail[i].node, i, firsts[chunk][i].rank - tail[i].rank);
+      tail[i] = lasts[chunk][i];
+    }
+  }
+
+  // For simplicity, the width to nullptr is always 0 (1 on the bottom level)
+  for (size_t i = 0; i < kMaxLevel_; i++) {
+    SetNext(tail[i].node, i, nullptr);
+    SetWidth(tail[i].node, i, i == 0 ? 1 : 0);
+  }
+
+  level_ = *std::max_element(levels.begin(), levels.end());
+  width_ = offsets.back();
+  if constexpr (kAugmented_) AugmentAll();
+}
+
+// Returns the node at `index`, or a null pointer if there is none.
+// The widths lead to the node in O(log n).
+template <typename T, typename Links>
+jhr::Skip_Node<T, Links>* jhr::Skip_List<T, Links>::NodeAt(size_t index) const {
+  static_assert(kRanked_, "SKIP_LIST: no_rank links hold no widths");
+  size_t w{index + 1};
+
+  Skip_Node<T, Links>* x{head_};
+
+  for (size_t i = level_; i > 0; i--) {
+    while (Next(x, i - 1) != nullptr && Width(x, i - 1) <= w) {
+      w -= Width(x, i - 1);
+      x = Next(x, i - 1);
+      if (w == 0) return x;
+    }
+  }
+  return nullptr;
+}
+
+// Calls `function(element)` on every element of the list.
+// The list is split by index in slices of equal length, every slice being
+// walked on its own thread. `function` must be safe to call concurrently and
+// the list must not be modified until the call returns.
+template <typename T, typename Links>
+template <typename Function>
+void jhr::Skip_List<T, Links>::parallel_for_each(Function const& function,
+                                                 size_t threads) const {
+  ForEachChunk(0, width_, Chunks(width_, threads),
+               [&](size_t, Skip_Node<T, Links> const* x, size_t count) {
+                 for (; count > 0; count--, x = Next(x, 0))
+                   function(*x->ptr_);
+               });
+}
+
+// Calls `function(element)` on every element in [low, high).
+template <typename T, typename Links>
+template <typename Function>
+void jhr::Skip_List<T, Links>::parallel_for_each(T const& low, T const& high,
+                                                 Function const& function,
+                                                 size_t threads) const {
+  size_t first{Rank(low)};
+  size_t last{std::max(first, Rank(high))};
+  ForEachChunk(first, last, Chunks(last - first, threads),
+               [&](size_t, Skip_Node<T, Links> const* x, size_t count) {
+                 for (; count > 0; count--, x = Next(x, 0))
+                   function(*x->ptr_);
+               });
+}
+
+// Reduces the list to a single value. Every slice of the list is folded on
+// its own thread starting from `identity`, with `fold(value, element)`, then
+// the results of the slices are merged in order with `combine(left, right)`.
+template <typename T, typename Links>
+template <typename R, typename Fold, typename Combine>
+R jhr::Skip_List<T, Links>::parallel_reduce(R const& identity, Fold const& fold,
+                                            Combine const& combine,
+                                            size_t threads) const {
+  return ReduceIndices(0, width_, identity, fold, combine, threads);
+}
+
+// Reduces the elements in [low, high) to a single value.
+template <typename T, typename Links>
+template <typename R, typename Fold, typename Combine>
+R jhr::Skip_List<T, Links>::parallel_reduce(T const& low, T const& high,
+                                            R const& identity, Fold const& fold,
+                                            Combine const& combine,
+                                            size_t threads) const {
+  size_t first{Rank(low)};
+  return ReduceIndices(first, std::max(first, Rank(high)), identity, fold,
+                       combine, threads);
+}
+
+// Reduces the elements in the index range [first, last).
+template <typename T, typename Links>
+template <typename R, typename Fold, typename Combine>
+R jhr::Skip_List<T, Links>::ReduceIndices(size_t first, size_t last,
+                                          R const& identity, Fold const& fold,
+                                          Combine const& combine,
+                                          size_t threads) const {
+  size_t chunks{Chunks(last - first, threads)};
+  std::vector<R> results(chunks, identity);
+
+  ForEachChunk(first, last, chunks,
+               [&](size_t chunk, Skip_Node<T, Links> const* x, size_t count) {
+                 R& result{results[chunk]};
+                 for (; count > 0; count--, x = Next(x, 0))
+                   result = fold(std::move(result), *x->ptr_);
+               });
+
+  R result{std::move(results[0])};
+  for (size_t chunk = 1; chunk < chunks; chunk++)
+    result = combine(std::move(result), results[chunk]);
+  return result;
+}
+
+template <typename T, typename Links>
+typename jhr::Skip_List<T, Links>::iterator
+jhr::Skip_List<T, Links>::lower_bound(T const& value) const {
+  Skip_Node<T, Links> const* x{head_};
+
+  for (size_t i = level_; i > 0; i--) {
+    while (Next(x, i - 1) != nullptr && *(Next(x, i - 1)->ptr_) < value) {
+      x = Next(x, i - 1);
+    }
+  }
+  return iterator{this, Next(x, 0)};
+}
+
+// Descends towards `x`, stopping on every level at the node linking to it
+// or at the last node before its element. With back links, the predecessors
+// on the levels of `x` are its back links, and above them the walk back climbs
+// from tower to tower: no element is compared.
+template <typename T, typename Links>
+void jhr::Skip_List<T, Links>::Predecessors(
+    Skip_Node<T, Links> const* x, Skip_Node<T, Links>** update) const {
+  if constexpr (kBackLinked_) {
+    size_t height{x->level()};
+    for (size_t i = 0; i < height; i++) update[i] = Prev(x, i);
+
+    Skip_Node<T, Links>* y{update[height - 1]};
+    for (size_t i = height; i < level_; i++) {
+      while (y->level() <= i) y = Prev(y, y->level() - 1);
+      update[i] = y;
+    }
+    return;
+  }
+
+  Skip_Node<T, Links>* y{head_};
+
+  for (size_t i = level_; i > 0; i--) {
+    while (Next(y, i - 1) != nullptr && Next(y, i - 1) != x &&
+           *(Next(y, i - 1)->ptr_) < *x->ptr_) {
+      y = Next(y, i - 1);
+    }
+    update[i - 1] = y;
+  }
+
+  // Elements of a multiset equal to `x` and before it are walked over on the
+  // bottom level
+  while (Next(update[0], 0) != x) {
+    y = Next(update[0], 0);
+    for (size_t i = 0; i < y->level(); i++) update[i] = y;
+  }
+}
+
+// Returns the optimal max level based on the probability `p` to add a new
+// level and the estimated maximum number of elements `N`
+// If `p` is invalid (p > 1 || p < 0) returns 0
+template <typename T, typename Links>
+inline size_t jhr::Skip_List<T, Links>::MaxLevel(
+    size_t N /*maximum number of elements*/, float p) {
+  if (!(0.0F <= p <= 1.0F)) return 0;
+  return static_cast<size_t>(log(N) / log(1 / p));
+}
+
+// The nodes of `other` join the arena of the list, the two bottom levels are
+// merged into a single run of nodes and every level is relinked over it.
+template <typename T, typename Links>
+void jhr::Skip_List<T, Links>::merge(Skip_List& other) {
+  if (&other == this || other.empty()) return;
+
+  // Towers higher than the list can neither be concatenated nor relinked,
+  // only `InsertNode()` cuts them down
+  bool too_high{other.level_ > kMaxLevel_};
+
+  Skip_Node<T, Links>* last{head_};
+  for (size_t i = level_; i > 0; i--)
+    while (Next(last, i - 1) != nullptr) last = Next(last, i - 1);
+  if (!too_high &&
+      (last == head_ || *last->ptr_ < *other.Next(other.head_, 0)->ptr_))
+    return concat(other);
+
+  CheckLength(width_ + other.width_);
+
+  // Small lists are inserted one by one, as in `insert_bulk()`: their
+  // elements are moved with the heights of their towers, as by `extract()`
+  // and `insert(node_handle&&)`
+  if (too_high || other.width_ * level_ < width_) {
+    std::vector<std::pair<T const*, size_t>> theirs;
+    theirs.reserve(other.width_);
+    for (Skip_Node<T, Links>* y = other.Next(other.head_, 0); y;
+         y = other.Next(y, 0))
+      theirs.emplace_back(y->ptr_, y->level());
+    other.Reset();
+
+    size_t moved{0};
+    try {
+      for (; moved < theirs.size(); moved++)
+        delete InsertNode(theirs[moved].first, theirs[moved].second).second;
+    } catch (...) {
+      for (; moved < theirs.size(); moved++) delete theirs[moved].first;
+      throw;
+    }
+    return;
+  }
+
+  std::vector<Skip_Node<T, Links>*> theirs;
+  theirs.reserve(other.width_);
+  for (Skip_Node<T, Links>* y = other.Next(other.head_, 0); y;
+       y = other.Next(y, 0))
+    theirs.push_back(y);
+
+  Skip_Node<T, Links>* other_head{other.head_};
+  std::vector<uint32_t> numbers{arena_.splice(other.arena_)};
+  if constexpr (kNumbered_) {
+    other_head->number_ =
+        internal::Node_Arena::renumber(other_head->number_, numbers);
+    for (Skip_Node<T, Links>* y : theirs)
+      y->number_ = internal::Node_Arena::renumber(y->number_, numbers);
+  }
+
+  std::vector<std::vector<Skip_Node<T, Links>*>> nodes(1);
+  nodes[0].reserve(width_ + theirs.size());
+
+  Skip_Node<T, Links>* x{Next(head_, 0)};
+  for (Skip_Node<T, Links>* y : theirs) {
+    while (x != nullptr && *x->ptr_ < *y->ptr_) {
+      nodes[0].push_back(x);
+      x = Next(x, 0);
+    }
+
+    if (x != nullptr && *x->ptr_ == *y->ptr_) {
+      delete x->ptr_;
+      x->ptr_ = y->ptr_;
+      DeleteNode(y);
+    } else {
+      nodes[0].push_back(y);
+    }
+  }
+  for (; x != nullptr; x = Next(x, 0)) nodes[0].push_back(x);
+
+  DeleteNode(other_head);
+  other.Reset();
+  Link(nodes);
+}
+
+template <typename T, typename Links>
+size_t jhr::Skip_List<T, Links>::RandomLevel(std::minstd_rand& random) const {
+  std::uniform_real_distribution<float> distribution{0.0f, 1.0f};
+  float rnd{distribution(random)};
+  size_t level{1};
+  while (rnd < p_ && level < kMaxLevel_ - 1) {
+    level++;
+    rnd = distribution(random);
+  }
+  return level;
+}
+
+// Returns the number of elements strictly smaller than `value`.
+template <typename T, typename Links>
+size_t jhr::Skip_List<T, Links>::Rank(T const& value) const {
+  static_assert(kRanked_, "SKIP_LIST: no_rank links hold no widths");
+  size_t rank{0};
+
+  Skip_Node<T, Links> const* x{head_};
+
+  for (size_t i = level_; i > 0; i--) {
+    while (Next(x, i - 1) != nullptr && *(Next(x, i - 1)->ptr_) < value) {
+      rank += Width(x, i - 1);
+      x = Next(x, i - 1);
+    }
+  }
+  return rank;
+}
+
+// The predecessors of the last node on every level are the last nodes
+// linking to it or to nothing: the descent stops before the node whose
+// successor on the bottom level is null.
+template <typename T, typename Links>
+T const* jhr::Skip_List<T, Links>::pop_max() {
+  if (empty()) return nullptr;
+
+  std::unique_ptr<Skip_Node<T, Links>* []> update {
+    new jhr::Skip_Node<T, Links>* [level_] {}
+  };
+
+  if constexpr (kBackLinked_) {
+    Predecessors(Tail(0), update.get());
+  } else {
+    Skip_Node<T, Links>* x{head_};
+
+    for (size_t i = level_; i > 0; i--) {
+      while (Next(x, i - 1) != nullptr &&
+             Next(Next(x, i - 1), 0) != nullptr) {
+        x = Next(x, i - 1);
+      }
+      update[i - 1] = x;
+    }
+  }
+
+  return Unlink(update.get(), Next(update[0], 0));
+}
+
+template <typename T, typename Links>
+T const* jhr::Skip_List<T, Links>::pop_min() {
+  Skip_Node<T, Links>* x{Next(head_, 0)};
+  if (x == nullptr) return nullptr;
+
+  for (size_t i = 0; i < level_; i++) {
+    if (i < x->level()) {
+      // The head now links to where `x` linked, with the same width
+      SetNext(head_, i, Next(x, i));
+      if constexpr (kRanked_) SetWidth(head_, i, Width(x, i));
+    } else if constexpr (kRanked_) {
+      // The width to nullptr is always 0 and does not need updating
+      if (Next(head_, i)) SetWidth(head_, i, Width(head_, i) - 1);
+    }
+    if constexpr (kAugmented_) Augment(head_, i);
+  }
+
+  T const* old_data = x->ptr_;
+  DeleteNode(x);
+  width_--;
+
+  // Updates the list's max level
+  while (level_ > 1 && Next(head_, level_ - 1) == nullptr) level_--;
+
+  return old_data;
+}
+
+// Removes an element from the skip list and returns a boolean if the
+// operation was successful
+template <typename T, typename Links>
+T const* jhr::Skip_List<T, Links>::remove(T const& ptr) {
+  std::unique_ptr<Skip_Node<T, Links>* []> update {
+    new jhr::Skip_Node<T, Links>* [level_] {}
+  };
+
+  Skip_Node<T, Links>* x{head_};
+
+  for (size_t i = level_; i > 0; i--) {
+    while (Next(x, i - 1) != nullptr && *(Next(x, i - 1)->ptr_) < ptr) {
+      x = Next(x, i - 1);
+    }
+    update[i - 1] = x;
+  }
+
+  x = Next(x, 0);
+
+  // Could not find `*ptr` in the skip list
+  if (x == nullptr) return nullptr;
+  if (!(*(x->ptr_) == ptr)) return nullptr;
+
+  return Unlink(update.get(), x);
+};
+
+// Removes the `index`th element of the skip list and returns it.
+// Uses the widths to find the element, no comparison is made.
+template <typename T, typename Links>
+T const* jhr::Skip_List<T, Links>::remove_at(size_t index) {
+  static_assert(kRanked_, "SKIP_LIST: no_rank links hold no widths");
+  if (index >= width_) throw std::overflow_error("SKIP_LIST");
+
+  std::unique_ptr<Skip_Node<T, Links>* []> update {
+    new jhr::Skip_Node<T, Links>* [level_] {}
+  };
+
+  // Number of nodes left to skip before reaching the predecessor
+  size_t w{index};
+
+  Skip_Node<T, Links>* x{head_};
+
+  for (size_t i = level_; i > 0; i--) {
+    while (Next(x, i - 1) != nullptr && Width(x, i - 1) <= w) {
+      w -= Width(x, i - 1);
+      x = Next(x, i - 1);
+    }
+    update[i - 1] = x;
+  }
+
+  return Unlink(update.get(), Next(x, 0));
+}
+
+template <typename T, typename Links>
+void jhr::Skip_List<T, Links>::Reset() {
+  arena_ = internal::Node_Arena{arena_.huge_pages()};
+  head_ = CreateNode(nullptr, kMaxLevel_);
+  level_ = 1;
+  width_ = 0;
+}
+
+// Runs `function(task)` for every task in [0, tasks), each one on its own
+// thread. The calling thread runs the first task.
+template <typename T, typename Links>
+template <typename Function>
+void jhr::Skip_List<T, Links>::RunParallel(size_t tasks,
+                                           Function const& function) {
+  std::vector<std::thread> workers;
+  for (size_t task = 1; task < tasks; task++)
+    workers.emplace_back([&function, task] { function(task); });
+  if (tasks > 0) function(0);
+  for (std::thread& worker : workers) worker.join();
+}
+
+// Writes a snapshot of the list with trivially copyable elements.
+template <typename T, typename Links>
+void jhr::Skip_List<T, Links>::save(std::ostream& out, bool widths) const {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "T must be trivially copyable, pass a writer to save()");
+  save(
+      out,
+      [](std::ostream& records, T const& value) {
+        internal::WritePod(records, value);
+      },
+      widths);
+}
+
+// Writes a snapshot of the list to the file at `path`.
+template <typename T, typename Links>
+void jhr::Skip_List<T, Links>::save(std::string const& path,
+                                    bool widths) const {
+  std::ofstream out{path, std::ios::binary | std::ios::trunc};
+  if (!out) throw std::runtime_error("SKIP_LIST: cannot open " + path);
+  save(out, widths);
+  out.flush();
+  if (!out) throw std::runtime_error("SKIP_LIST: cannot write " + path);
+}
+
+// Writes a snapshot of the list, writing the elements with
+// `write(out, element)`.
+// The snapshot is made of a header (magic, flags, number of elements,
+// number of levels and checksum) followed by a record per node in order:
+// its height, its widths if `widths` is set, then its element. The records
+// are written twice, a first time to compute the checksum stored in the
+// header.
+template <typename T, typename Links>
+template <typename Writer>
+void jhr::Skip_List<T, Links>::save(std::ostream& out, Writer const& write,
+                                    bool widths) const {
+  // `no_rank` lists have no widths to save
+  widths = widths && kRanked_;
+  uint32_t flags{widths ? kWidthsFlag_ : 0};
+
+  internal::Checksum_Buffer hashing;
+  std::ostream hashed{&hashing};
+  internal::WritePod(hashed, flags);
+  internal::WritePod<uint64_t>(hashed, width_);
+  internal::WritePod<uint64_t>(hashed, level_);
+  SaveRecords(hashed, write, widths);
+
+  out.write(kMagic_, sizeof(kMagic_));
+  internal::WritePod(out, flags);
+  internal::WritePod<uint64_t>(out, width_);
+  internal::WritePod<uint64_t>(out, level_);
+  internal::WritePod<uint64_t>(out, hashing.checksum());
+  SaveRecords(out, write, widths);
+}
+
+// Writes the widths of the head if `widths` is set, then the record of every
+// node of the list in order.
+template <typename T, typename Links>
+template <typename Writer>
+void jhr::Skip_List<T, Links>::SaveRecords(std::ostream& out,
+                                           Writer const& write,
+                                           bool widths) const {
+  // Widths to nullptr are saved as 0 (1 on the bottom level)
+  auto width = [this](Skip_Node<T, Links> const* x, size_t i) -> uint64_t {
+    if constexpr (kRanked_)
+      if (Next(x, i)) return Width(x, i);
+    return i == 0 ? 1 : 0;
+  };
+
+  if (widths)
+    for (size_t i = 0; i < level_; i++)
+      internal::WritePod(out, width(head_, i));
+
+  for (Skip_Node<T, Links> const* x = Next(head_, 0); x;
+       x = Next(x, 0)) {
+    internal::WritePod(out, static_cast<uint8_t>(x->level()));
+    if (widths)
+      for (size_t i = 0; i < x->level(); i++)
+        internal::WritePod(out, width(x, i));
+    write(out, *x->ptr_);
+  }
+}
+
+// Climbs while the links above still end before `value`, as a finger
+// search does, then walks down again.
+template <typename T, typename Links>
+jhr::Skip_Node<T, Links>* jhr::Skip_List<T, Links>::Seek(
+    Skip_Node<T, Links>* from, T const& value) const {
+  Skip_Node<T, Links>* x{from};
+
+  auto ends_before = [&](size_t i) {
+    return Next(x, i) != nullptr && *(Next(x, i)->ptr_) < value;
+  };
+
+  for (size_t i = 0;;) {
+    if (i + 1 < std::min(x->level(), level_) && ends_before(i + 1))
+      i++;
+    else if (ends_before(i))
+      x = Next(x, i);
+    else if (i > 0)
+      i--;
+    else
+      return x;
+  }
+}
+
+template <typename T, typename Links>
+jhr::Skip_List<T, Links> jhr::Skip_List<T, Links>::set_difference(
+    Skip_List const& other) const {
+  Skip_List result(kMaxLevel_, p_);
+  std::vector<std::vector<Skip_Node<T, Links>*>> nodes(1);
+
+  Skip_Node<T, Links>* finger{other.head_};
+  for (Skip_Node<T, Links>* x = Next(head_, 0); x; x = Next(x, 0)) {
+    finger = other.Seek(finger, *x->ptr_);
+    Skip_Node<T, Links>* y{other.Next(finger, 0)};
+    if (y == nullptr || !(*y->ptr_ == *x->ptr_))
+      nodes[0].push_back(
+          result.CreateNode(new T{*x->ptr_}, result.RandomLevel()));
+  }
+
+  result.Link(nodes);
+  return result;
+}
+
+// Walks the shorter list, the elements are copied from the list.
+template <typename T, typename Links>
+jhr::Skip_List<T, Links> jhr::Skip_List<T, Links>::set_intersection(
+    Skip_List const& other) const {
+  Skip_List result(kMaxLevel_, p_);
+  std::vector<std::vector<Skip_Node<T, Links>*>> nodes(1);
+
+  bool walk_list{width_ <= other.width_};
+  Skip_List const& walked{walk_list ? *this : other};
+  Skip_List const& sought{walk_list ? other : *this};
+
+  Skip_Node<T, Links>* finger{sought.head_};
+  for (Skip_Node<T, Links>* x = walked.Next(walked.head_, 0); x;
+       x = walked.Next(x, 0)) {
+    finger = sought.Seek(finger, *x->ptr_);
+    Skip_Node<T, Links>* y{sought.Next(finger, 0)};
+    if (y != nullptr && *y->ptr_ == *x->ptr_)
+      nodes[0].push_back(result.CreateNode(
+          new T{walk_list ? *x->ptr_ : *y->ptr_}, result.RandomLevel()));
+  }
+
+  result.Link(nodes);
+  return result;
+}
+
+// Merges the bottom levels of the two lists, the union holds every element
+// of both so walking them all costs nothing more.
+template <typename T, typename Links>
+jhr::Skip_List<T, Links> jhr::Skip_List<T, Links>::set_union(
+    Skip_List const& other) const {
+  Skip_List result(kMaxLevel_, p_);
+  result.CheckLength(width_ + other.width_);
+  std::vector<std::vector<Skip_Node<T, Links>*>> nodes(1);
+
+  auto append = [&](T const& value) {
+    nodes[0].push_back(result.CreateNode(new T{value}, result.RandomLevel()));
+  };
+
+  Skip_Node<T, Links>* x{Next(head_, 0)};
+  for (Skip_Node<T, Links>* y = other.Next(other.head_, 0); y;
+       y = other.Next(y, 0)) {
+    for (; x != nullptr && *x->ptr_ < *y->ptr_; x = Next(x, 0))
+      append(*x->ptr_);
+    if (x != nullptr && *x->ptr_ == *y->ptr_) x = Next(x, 0);
+    append(*y->ptr_);
+  }
+  for (; x != nullptr; x = Next(x, 0)) append(*x->ptr_);
+
+  result.Link(nodes);
+  return result;
+}
+
+// The new list shares the arena of the list, so that the moved nodes can be
+// handed back to its arena. Its head is carved out of the arena of the list
+// too, so that splitting and concatenating again needs no new chunk. On
+// every level, the link leaving the last node staying is moved to the head
+// of the new list, its width becoming the rank of the node it leads to in
+// the new list.
+template <typename T, typename Links>
+jhr::Skip_List<T, Links> jhr::Skip_List<T, Links>::SplitAfter(
+    Skip_Node<T, Links>* const* before, size_t const* before_rank) {
+  Skip_Node<T, Links>* head{CreateNode(nullptr, kMaxLevel_)};
+  Skip_List upper(kMaxLevel_, p_, arena_.share(), head);
+
+  for (size_t i = 0; i < level_; i++) {
+    Skip_Node<T, Links>* first{Next(before[i], i)};
+    if constexpr (kBackLinked_)
+      if (first) upper.head_->forward_[i].prev = Tail(i);
+    upper.SetNext(upper.head_, i, first);
+    SetNext(before[i], i, nullptr);
+
+    if constexpr (kRanked_) {
+      // For simplicity, the width to nullptr is always 0 (1 on the bottom
+      // level)
+      if (first)
+        upper.SetWidth(upper.head_, i,
+                       before_rank[i] + Width(before[i], i) - before_rank[0]);
+      SetWidth(before[i], i, i == 0 ? 1 : 0);
+    }
+  }
+  upper.level_ = level_;
+
+  if constexpr (kRanked_) {
+    upper.width_ = width_ - before_rank[0];
+  } else {
+    for (Skip_Node<T, Links>* x = Next(upper.head_, 0); x; x = Next(x, 0))
+      upper.width_++;
+  }
+  width_ -= upper.width_;
+
+  if constexpr (kAugmented_) {
+    AugmentPath(before, level_);
+    for (size_t i = 0; i < upper.level_; i++)
+      upper.Augment(upper.head_, i);
+  }
+
+  // Updates the max level of both lists
+  while (level_ > 1 && Next(head_, level_ - 1) == nullptr) level_--;
+  while (upper.level_ > 1 && Next(upper.head_, upper.level_ - 1) == nullptr)
+    upper.level_--;
+  return upper;
+}
+
+template <typename T, typename Links>
+jhr::Skip_List<T, Links> jhr::Skip_List<T, Links>::split_at(T const& value) {
+  std::vector<Skip_Node<T, Links>*> before(level_);
+  std::vector<size_t> before_rank(level_);
+
+  Skip_Node<T, Links>* x{head_};
+  size_t rank{0};
+
+  for (size_t i = level_; i > 0; i--) {
+    while (Next(x, i - 1) != nullptr && *(Next(x, i - 1)->ptr_) < value) {
+      if constexpr (kRanked_) rank += Width(x, i - 1);
+      x = Next(x, i - 1);
+    }
+    before[i - 1] = x;
+    before_rank[i - 1] = rank;
+  }
+
+  return SplitAfter(before.data(), before_rank.data());
+}
+
+// Uses the widths to find the split, no comparison is made.
+// If `index` is greater than the width of the skip list throws an
+// `std::overflow_error`.
+template <typename T, typename Links>
+jhr::Skip_List<T, Links> jhr::Skip_List<T, Links>::split_at_index(
+    size_t index) {
+  static_assert(kRanked_, "SKIP_LIST: no_rank links hold no widths");
+  if (index > width_) throw std::overflow_error("SKIP_LIST");
+
+  std::vector<Skip_Node<T, Links>*> before(level_);
+  std::vector<size_t> before_rank(level_);
+
+  Skip_Node<T, Links>* x{head_};
+  size_t rank{0};
+
+  for (size_t i = level_; i > 0; i--) {
+    while (Next(x, i - 1) != nullptr && rank + Width(x, i - 1) <= index) {
+      rank += Width(x, i - 1);
+      x = Next(x, i - 1);
+    }
+    before[i - 1] = x;
+    before_rank[i - 1] = rank;
+  }
+
+  return SplitAfter(before.data(), before_rank.data());
+}
+
+// Unlinks `x` from the list, `update` holding its predecessor on every
+// level. Deletes the node and returns the data it held.
+template <typename T, typename Links>
+T const* jhr::Skip_List<T, Links>::Unlink(Skip_Node<T, Links>** update,
+                                          Skip_Node<T, Links>* x) {
+  for (size_t i = 0; i < level_; i++) {
+    if (Next(update[i], i) != x) {
+      // The width to nullptr is always 0 and does not need updating
+      if constexpr (kRanked_)
+        if (Next(update[i], i))
+          SetWidth(update[i], i, Width(update[i], i) - 1);
+    } else {
+      SetNext(update[i], i, Next(x, i));
+
+      if constexpr (kRanked_) {
+        if (Width(x, i) > 0)
+          SetWidth(update[i], i, Width(update[i], i) + Width(x, i) - 1);
+        else
+          SetWidth(update[i], i, 0);
+      }
+    }
+  }
+
+  if constexpr (kAugmented_) AugmentPath(update, level_);
+
+  T const* old_data = x->ptr_;
+  DeleteNode(x);
+  width_--;
+
+  // Updates the list's max level
+  while (level_ > 1 && Next(head_, level_ - 1) == nullptr) level_--;
+
+  return old_data;
+}
+
+template <typename T>
+jhr::Frozen_Skip_List<T>::Frozen_Skip_List(std::vector<T> values)
+    : values_{std::move(values)} {
+  if (values_.empty()) return;
+
+  ranks_.resize(values_.size() + 1);
+  size_t rank{0};
+  Layout(1, rank);
+
+  // `keys_[0]` is never read, it only keeps the tree rooted at 1.
+  keys_.reserve(values_.size() + 1);
+  keys_.push_back(values_.front());
+  for (size_t k = 1; k <= values_.size(); k++)
+    keys_.push_back(values_[ranks_[k]]);
+}
+
+template <typename T>
+T const& jhr::Frozen_Skip_List<T>::at(size_t index) const {
+  if (index >= values_.size()) throw std::overflow_error("SKIP_LIST");
+  return values_[index];
+}
+
+template <typename T>
+T const* jhr::Frozen_Skip_List<T>::find(T const& value) const {
+  size_t index{Search(value)};
+  if (index < values_.size() && values_[index] == value)
+    return &values_[index];
+  return nullptr;
+}
+
+template <typename T>
+void jhr::Frozen_Skip_List<T>::Layout(size_t k, size_t& rank) {
+  if (k > values_.size()) return;
+  Layout(2 * k, rank);
+  ranks_[k] = rank++;
+  Layout(2 * k + 1, rank);
+}
+
+template <typename T>
+typename jhr::Frozen_Skip_List<T>::iterator
+jhr::Frozen_Skip_List<T>::lower_bound(T const& value) const {
+  return values_.begin() + static_cast<std::ptrdiff_t>(Search(value));
+}
+
+// Descends the tree, going right whenever the key is smaller than `value`.
+// The comparison is added to the index rather than branched on. The last node
+// where the descent went left is the answer: the path below it only went
+// right, which appends trailing ones to its index.
+template <typename T>
+size_t jhr::Frozen_Skip_List<T>::Search(T const& value) const {
+  size_t n{values_.size()};
+  size_t k{1};
+  while (k <= n) k = 2 * k + static_cast<size_t>(keys_[k] < value);
+
+  while (k & 1) k >>= 1;
+  k >>= 1;
+  return k == 0 ? n : ranks_[k];
+}
+
+template <typename T>
+template <typename Links>
+void jhr::Frozen_Skip_List<T>::thaw(Skip_List<T, Links>& list,
+                                   size_t threads) const {
+  list.build(values_.begin(), values_.end(), threads);
+}
+
+template <typename T, typename Links>
+size_t jhr::Skip_Multiset<T, Links>::count(T const& value) const {
+  if constexpr (std::is_same<Links, no_rank>::value) {
+    auto [first, last] = equal_range(value);
+    return std::distance(first, last);
+  } else {
+    size_t low{0}, high{0};
+    list_.Bound(value, false, &low);
+    list_.Bound(value, true, &high);
+    return high - low;
+  }
+}
+
+template <typename T, typename Links>
+template <typename... Args>
+typename jhr::Skip_Multiset<T, Links>::iterator
+jhr::Skip_Multiset<T, Links>::emplace(Args&&... args) {
+  std::unique_ptr<T const> data{new T{std::forward<Args>(args)...}};
+  size_t level{list_.RandomLevel()};
+  Skip_Node<T, Links>* node{
+      list_.template InsertNode<false>(data.get(), level).first};
+  data.release();
+  return iterator{&list_, node};
+}
+
+template <typename T, typename Links>
+std::pair<typename jhr::Skip_Multiset<T, Links>::iterator,
+          typename jhr::Skip_Multiset<T, Links>::iterator>
+jhr::Skip_Multiset<T, Links>::equal_range(T const& value) const {
+  return {lower_bound(value), upper_bound(value)};
+}
+
+// The first element inserted is the first of its run: `find()` leads to it
+// comparing with `<` only, and erasing it walks over no equal element.
+template <typename T, typename Links>
+size_t jhr::Skip_Multiset<T, Links>::erase(T const& value, bool all) {
+  if (all) return list_.EraseRange(value, value, true);
+
+  iterator first{find(value)};
+  if (first == end()) return 0;
+  list_.erase(first);
+  return 1;
+}
+
+template <typename T, typename Links>
+typename jhr::Skip_Multiset<T, Links>::iterator
+jhr::Skip_Multiset<T, Links>::find(T const& value) const {
+  iterator it{lower_bound(value)};
+  if (it == end() || value < *it) return end();
+  return it;
+}
+
+template <typename T, typename Links>
+typename jhr::Skip_Multiset<T, Links>::iterator
+jhr::Skip_Multiset<T, Links>::lower_bound(T const& value) const {
+  return iterator{&list_, list_.Next(list_.Bound(value, false), 0)};
+}
+
+template <typename T, typename Links>
+typename jhr::Skip_Multiset<T, Links>::iterator
+jhr::Skip_Multiset<T, Links>::upper_bound(T const& value) const {
+  return iterator{&list_, list_.Next(list_.Bound(value, true), 0)};
+}
+
+template <typename T, typename Links>
+jhr::Sliding_Window<T, Links>::Sliding_Window(size_t capacity)
+    : kCapacity_{capacity} {
+  if (capacity == 0)
+    throw std::invalid_argument("SKIP_LIST: window of no sample");
+}
+
+template <typename T, typename Links>
+void jhr::Sliding_Window<T, Links>::clear() {
+  samples_.clear();
+  arrivals_.clear();
+}
+
+template <typename T, typename Links>
+void jhr::Sliding_Window<T, Links>::push(T const& sample) {
+  arrivals_.push_back(samples_.insert(sample));
+
+  if (arrivals_.size() > kCapacity_) {
+    samples_.erase(arrivals_.front());
+    arrivals_.pop_front();
+  }
+}
+
+template <typename T, typename Links>
+T const& jhr::Sliding_Window<T, Links>::quantile(double q) const {
+  return samples_.at(QuantileIndex(q));
+}
+
+template <typename T, typename Links>
+size_t jhr::Sliding_Window<T, Links>::QuantileIndex(double q) const {
+  if (empty()) throw std::overflow_error("SKIP_LIST");
+  if (!(0.0 <= q && q <= 1.0))
+    throw std::invalid_argument("SKIP_LIST: quantile out of [0, 1]");
+  return static_cast<size_t>(q * static_cast<double>(length() - 1));
+}
+
+// The indices are sorted so that the searches share a single path, then the
+// samples are put back in the order of `qs`.
+template <typename T, typename Links>
+std::vector<T> jhr::Sliding_Window<T, Links>::quantiles(
+    std::vector<double> const& qs) const {
+  std::vector<size_t> order(qs.size());
+  std::vector<size_t> indices(qs.size());
+  for (size_t i = 0; i < qs.size(); i++) {
+    order[i] = i;
+    indices[i] = QuantileIndex(qs[i]);
+  }
+  std::sort(order.begin(), order.end(),
+            [&](size_t a, size_t b) { return indices[a] < indices[b]; });
+
+  std::vector<size_t> sorted(qs.size());
+  for (size_t i = 0; i < qs.size(); i++) sorted[i] = indices[order[i]];
+
+  std::vector<T> values;
+  values.reserve(qs.size());
+  samples_.at(sorted.begin(), sorted.end(), std::back_inserter(values));
+
+  std::vector<T> result(values);
+  for (size_t i = 0; i < qs.size(); i++) result[order[i]] = values[i];
+  return result;
+}
+
+template <typename T, typename Clock>
+void jhr::Expiring_Skip_List<T, Clock>::clear() {
+  deadlines_.clear();
+  entries_.clear();
+}
+
+template <typename T, typename Clock>
+T const* jhr::Expiring_Skip_List<T, Clock>::find(T const& value,
+                                                 time_point now) const {
+  Entry const* entry{entries_.find(Entry{value})};
+  if (entry == nullptr || !(now < entry->deadline_)) return nullptr;
+  return &entry->key_;
+}
+
+// The replaced entry takes its deadline away with it.
+template <typename T, typename Clock>
+bool jhr::Expiring_Skip_List<T, Clock>::insert(T const& value,
+                                               time_point deadline) {
+  auto [it, replaced] = entries_.emplace(value, deadline);
+  std::unique_ptr<Entry const> old{replaced};
+  if (old) deadlines_.erase(old->expiry_);
+
+  it->expiry_ = deadlines_.insert(Expiry{deadline, &*it});
+  return old == nullptr;
+}
+
+template <typename T, typename Clock>
+std::optional<typename jhr::Expiring_Skip_List<T, Clock>::time_point>
+jhr::Expiring_Skip_List<T, Clock>::next_deadline() const {
+  if (deadlines_.empty()) return std::nullopt;
+  return deadlines_.begin()->deadline_;
+}
+
+template <typename T, typename Clock>
+bool jhr::Expiring_Skip_List<T, Clock>::remove(T const& value) {
+  Entry const* entry{entries_.find(Entry{value})};
+  if (entry == nullptr) return false;
+
+  deadlines_.erase(entry->expiry_);
+  delete entries_.remove(*entry);
+  return true;
+}
+
+// The earliest deadline is the first node of the deadline list: it is
+// unlinked from the head, then its entry is removed from the list.
+template <typename T, typename Clock>
+size_t jhr::Expiring_Skip_List<T, Clock>::sweep(time_point now,
+                                                size_t budget) {
+  size_t count{0};
+
+  while (count < budget && !deadlines_.empty() &&
+         !(now < deadlines_.begin()->deadline_)) {
+    std::unique_ptr<Expiry const> expiry{deadlines_.pop_min()};
+    delete entries_.remove(*expiry->entry_);
+    count++;
+  }
+  return count;
+}
+
+// The links split by the new tower lie below its height between the last
+// node before `key` on its top level and the next node of that level. A
+// tower higher than the list splits links over the whole list.
+template <typename T>
+typename jhr::Interval_Skip_List<T>::Node*
+jhr::Interval_Skip_List<T>::AddEndpoint(T const& key) {
+  Node* x{Find(key)};
+  if (x) return x;
+
+  size_t level{list_.RandomLevel()};
+
+  Node* first{list_.head_};
+  for (size_t i = list_.level_; i >= level; i--) {
+    while (list_.Next(first, i - 1) != nullptr &&
+           list_.Next(first, i - 1)->ptr_->key_ < key)
+      first = list_.Next(first, i - 1);
+  }
+
+  Restructure(first, list_.Next(first, level - 1), level, [&] {
+    std::unique_ptr<Endpoint const> data{new Endpoint{key}};
+    x = list_.InsertNode(data.get(), level).first;
+    data.release();
+  });
+  return x;
+}
+
+template <typename T>
+void jhr::Interval_Skip_List<T>::clear() {
+  FreeMarkers();
+  list_.clear();
+  length_ = 0;
+}
+
+template <typename T>
+void jhr::Interval_Skip_List<T>::DropEndpoint(Node* x) {
+  Endpoint const& endpoint{*x->ptr_};
+  if (!endpoint.starts_.empty() || endpoint.ends_ > 0) return;
+
+  size_t level{x->level()};
+
+  Node* first{list_.head_};
+  for (size_t i = list_.level_; i >= level; i--) {
+    while (list_.Next(first, i - 1) != nullptr &&
+           list_.Next(first, i - 1) != x &&
+           list_.Next(first, i - 1)->ptr_->key_ < endpoint.key_)
+      first = list_.Next(first, i - 1);
+  }
+
+  Restructure(first, list_.Next(x, level - 1), level, [&] {
+    // The intervals passing through the node were unmarked, leaving its
+    // markers empty
+    for (size_t i = 0; i < level; i++) delete x->forward_[i].markers;
+    delete list_.remove(endpoint);
+  });
+}
+
+template <typename T>
+typename jhr::Interval_Skip_List<T>::Node* jhr::Interval_Skip_List<T>::Find(
+    T const& key) const {
+  Node* x{list_.head_};
+  for (size_t i = list_.level_; i > 0; i--) {
+    while (list_.Next(x, i - 1) != nullptr &&
+           list_.Next(x, i - 1)->ptr_->key_ < key)
+      x = list_.Next(x, i - 1);
+  }
+
+  x = list_.Next(x, 0);
+  if (x == nullptr || key < x->ptr_->key_) return nullptr;
+  return x;
+}
+
+template <typename T>
+void jhr::Interval_Skip_List<T>::FreeMarkers() {
+  for (Node* x = list_.head_; x; x = list_.Next(x, 0)) {
+    for (size_t i = 0; i < x->level(); i++) {
+      delete x->forward_[i].markers;
+      x->forward_[i].markers = nullptr;
+    }
+  }
+}
+
+template <typename T>
+void jhr::Interval_Skip_List<T>::insert(T const& low, T const& high) {
+  if (high < low)
+    throw std::invalid_argument("SKIP_LIST: interval ends before it starts");
+
+  Node* x{AddEndpoint(low)};
+  Node* y{AddEndpoint(high)};
+
+  x->ptr_->starts_.push_back(
+      std::make_unique<Record>(Record{{low, high}, x, y}));
+  y->ptr_->ends_++;
+  Mark(x->ptr_->starts_.back().get(), true);
+  length_++;
+}
+
+template <typename T>
+void jhr::Interval_Skip_List<T>::Mark(Record* record, bool place) {
+  SetMarker(record->low_->ptr_->markers_, record, place);
+  Mark(record, place, record->low_, record->high_);
+  if (record->high_ != record->low_)
+    SetMarker(record->high_->ptr_->markers_, record, place);
+}
+
+// The path climbs while the link one level up stays inside the interval,
+// and comes down when the link overshoots its high endpoint. It only
+// depends on the towers between the endpoints, so walking it again finds
+// the markers it placed.
+template <typename T>
+void jhr::Interval_Skip_List<T>::Mark(Record* record, bool place, Node* from,
+                                      Node const* to) {
+  T const& high{record->interval_.high};
+
+  Node* x{from};
+  size_t i{0};
+  while (x != to) {
+    while (i + 1 < x->level() && list_.Next(x, i + 1) != nullptr &&
+           !(high < list_.Next(x, i + 1)->ptr_->key_))
+      i++;
+    while (list_.Next(x, i) == nullptr ||
+           high < list_.Next(x, i)->ptr_->key_)
+      i--;
+
+    // Kept once allocated, intervals are often unmarked to be marked again
+    std::vector<Record*>*& markers{x->forward_[i].markers};
+    if (markers == nullptr) markers = new std::vector<Record*>;
+    SetMarker(*markers, record, place);
+
+    x = list_.Next(x, i);
+    if (x != to) SetMarker(x->ptr_->markers_, record, place);
+  }
+}
+
+template <typename T>
+std::vector<typename jhr::Interval_Skip_List<T>::Interval>
+jhr::Interval_Skip_List<T>::overlap(T const& low, T const& high) const {
+  if (high < low)
+    throw std::invalid_argument("SKIP_LIST: interval ends before it starts");
+
+  std::vector<Interval> intervals{stab(low)};
+
+  Node* x{list_.Bound(Endpoint{low}, true)};
+  for (x = list_.Next(x, 0); x && !(high < x->ptr_->key_);
+       x = list_.Next(x, 0)) {
+    for (auto const& record : x->ptr_->starts_)
+      intervals.push_back(record->interval_);
+  }
+  return intervals;
+}
+
+template <typename T>
+bool jhr::Interval_Skip_List<T>::remove(T const& low, T const& high) {
+  Node* x{Find(low)};
+  if (x == nullptr) return false;
+
+  auto& starts{x->ptr_->starts_};
+  auto it = std::find_if(starts.begin(), starts.end(), [&](auto const& r) {
+    return r->interval_.high == high;
+  });
+  if (it == starts.end()) return false;
+
+  Node* y{(*it)->high_};
+  Mark(it->get(), false);
+  starts.erase(it);
+  y->ptr_->ends_--;
+  length_--;
+
+  DropEndpoint(x);
+  if (y != x) DropEndpoint(y);
+  return true;
+}
+
+// Every interval marked on the search path is picked up once: its path
+// either crosses the point on a single link, or passes through the node of
+// the point.
+template <typename T>
+std::vector<typename jhr::Interval_Skip_List<T>::Interval>
+jhr::Interval_Skip_List<T>::stab(T const& point) const {
+  std::vector<Interval> intervals;
+
+  Node const* x{list_.head_};
+  for (size_t i = list_.level_; i > 0; i--) {
+    while (list_.Next(x, i - 1) != nullptr &&
+           list_.Next(x, i - 1)->ptr_->key_ < point)
+      x = list_.Next(x, i - 1);
+
+    // Links ending on the point are marked on its node as well
+    Node const* y{list_.Next(x, i - 1)};
+    if (y != nullptr && point < y->ptr_->key_ && x->forward_[i - 1].markers)
+      for (Record const* record : *x->forward_[i - 1].markers)
+        intervals.push_back(record->interval_);
+  }
+
+  x = list_.Next(x, 0);
+  if (x != nullptr && !(point < x->ptr_->key_))
+    for (Record const* record : x->ptr_->markers_)
+      intervals.push_back(record->interval_);
+  return intervals;
+}
+
+// Links below `levels` cannot reach past `first` or `last`, and a path
+// leaves a node on the highest link that stays inside the interval whatever
+// link it came in on. The parts of the paths before `first` and after `last`
+// are left as they are.
+template <typename T>
+template <typename Change>
+void jhr::Interval_Skip_List<T>::Restructure(Node* first, Node const* last,
+                                             size_t levels,
+                                             Change const& change) {
+  std::vector<Record*> affected;
+
+  for (Node* x = first; x != last; x = list_.Next(x, 0)) {
+    for (size_t i = 0; i < std::min(levels, x->level()); i++) {
+      if (x->forward_[i].markers == nullptr) continue;
+      for (Record* record : *x->forward_[i].markers) {
+        if (record->affected_) continue;
+        record->affected_ = true;
+        affected.push_back(record);
       }
     }
   }
-  DisplayList();
-  throw std::overflow_error("SKIP_LIST");
-};
 
-// Centers a string by padding it left and right with spaces.
+  auto from = [&](Record const* record) {
+    bool inside{first == list_.head_ ||
+                first->ptr_->key_ < record->interval_.low};
+    return inside ? record->low_ : first;
+  };
+  auto to = [&](Record const* record) {
+    bool inside{last == nullptr ||
+                record->interval_.high < last->ptr_->key_};
+    return inside ? record->high_ : last;
+  };
+
+  for (Record* record : affected) {
+    Mark(record, false, from(record), to(record));
+    record->affected_ = false;
+  }
+  change();
+  for (Record* record : affected) Mark(record, true, from(record), to(record));
+}
+
+template <typename T>
+void jhr::Interval_Skip_List<T>::SetMarker(std::vector<Record*>& markers,
+                                           Record* record, bool place) {
+  if (place) {
+    markers.push_back(record);
+  } else {
+    auto it = std::find(markers.begin(), markers.end(), record);
+    *it = markers.back();
+    markers.pop_back();
+  }
+}
+
+template <typename T>
+jhr::Concurrent_Priority_Queue<T>::Concurrent_Priority_Queue(size_t threads)
+    : kSprayWidth_{[threads] {
+        // log^3 p elements per lane, p lanes: the spray lands on one of the
+        // first O(p log^3 p) elements of the queue.
+        size_t log_p{1};
+        while ((size_t{1} << log_p) < threads) log_p++;
+        return log_p * log_p * log_p;
+      }()} {
+  size_t lanes{threads > 0 ? threads : 1};
+  for (size_t i = 0; i < lanes; i++)
+    lanes_.push_back(std::make_unique<Lane>());
+}
+
+// Removes and returns the smallest element of the queue.
+// Locks every lane to find the one holding the smallest element.
+template <typename T>
+std::optional<T> jhr::Concurrent_Priority_Queue<T>::pop_min() {
+  std::vector<std::unique_lock<std::mutex>> locks;
+  locks.reserve(lanes_.size());
+  for (auto const& lane : lanes_) locks.emplace_back(lane->mutex_);
+
+  Lane* smallest{nullptr};
+  for (auto const& lane : lanes_) {
+    if (lane->list_.empty()) continue;
+    if (smallest == nullptr ||
+        *lane->list_.begin() < *smallest->list_.begin())
+      smallest = lane.get();
+  }
+
+  if (smallest == nullptr) return std::nullopt;
+  return PopAt(*smallest, 0);
+}
+
+template <typename T>
+T jhr::Concurrent_Priority_Queue<T>::PopAt(Lane& lane, size_t index) {
+  std::unique_ptr<T const> data{index == 0 ? lane.list_.pop_min()
+                                            : lane.list_.remove_at(index)};
+  width_--;
+  return *data;
+}
+
+// Removes and returns one of the smallest elements of the queue.
+// Tries random lanes without waiting on their locks and removes a random
+// element among the first `kSprayWidth_` of the first free lane. Falls back
+// on `pop_min()` when every lane tried was busy or empty.
+template <typename T>
+std::optional<T> jhr::Concurrent_Priority_Queue<T>::pop_spray() {
+  for (size_t attempt = 0; attempt < lanes_.size(); attempt++) {
+    Lane& lane{*lanes_[RandomLane()]};
+    std::unique_lock<std::mutex> lock{lane.mutex_, std::try_to_lock};
+    if (!lock.owns_lock() || lane.list_.empty()) continue;
+
+    size_t window{std::min(lane.list_.length(), kSprayWidth_)};
+    return PopAt(lane,
+                 std::uniform_int_distribution<size_t>{0, window - 1}(Random()));
+  }
+
+  return pop_min();
+}
+
+// Pushes `value` in a random lane, after the elements equal to it.
+template <typename T>
+void jhr::Concurrent_Priority_Queue<T>::push(T const& value) {
+  Lane& lane{*lanes_[RandomLane()]};
+  std::lock_guard<std::mutex> lock{lane.mutex_};
+
+  lane.list_.insert(value);
+  width_++;
+}
+
+// Returns the random engine of the calling thread.
+template <typename T>
+std::minstd_rand& jhr::Concurrent_Priority_Queue<T>::Random() {
+  thread_local std::minstd_rand random{
+      static_cast<std::minstd_rand::result_type>(
+          std::hash<std::thread::id>{}(std::this_thread::get_id()))};
+  return random;
+}
+
+template <typename T>
+size_t jhr::Concurrent_Priority_Queue<T>::RandomLane() const {
+  return std::uniform_int_distribution<size_t>{0, lanes_.size() - 1}(Random());
+}
+
+template <typename T>
+jhr::Sharded_Skip_List<T>::Sharded_Skip_List(size_t shard_count)
+    : kShardCount_{shard_count > 0 ? shard_count : 1} {
+  shards_.push_back(std::make_unique<Shard>());
+}
+
+// Returns a copy of the `index`th element of the sharded list.
+// Every shard is locked while the prefix sum over the shard sizes is computed
+// so that the answer is consistent across shards.
+template <typename T>
+T jhr::Sharded_Skip_List<T>::at(size_t index) const {
+  std::shared_lock<std::shared_mutex> router{router_mutex_};
+
+  std::vector<std::unique_lock<std::mutex>> locks;
+  locks.reserve(shards_.size());
+  for (auto const& shard : shards_) locks.emplace_back(shard->mutex_);
+
+  for (auto const& shard : shards_) {
+    size_t width{shard->list_.length()};
+    if (index < width) return shard->list_.at(index);
+    index -= width;
+  }
+  throw std::overflow_error("SKIP_LIST");
+}
+
+// Returns a copy of the element equal to `value` if it exists.
+template <typename T>
+std::optional<T> jhr::Sharded_Skip_List<T>::find(T const& value) const {
+  std::shared_lock<std::shared_mutex> router{router_mutex_};
+  Shard const& shard{*shards_[Route(value)]};
+  std::lock_guard<std::mutex> lock{shard.mutex_};
+
+  T const* found{shard.list_.find(value)};
+  if (found == nullptr) return std::nullopt;
+  return *found;
+}
+
+// Inserts `value` in the shard owning its key range, replacing any equal
+// element. Returns `true` if the element was not already in the list.
+// Triggers a rebalance if the shard grew too large.
+template <typename T>
+bool jhr::Sharded_Skip_List<T>::insert(T const& value) {
+  bool inserted;
+  bool skewed;
+  {
+    std::shared_lock<std::shared_mutex> router{router_mutex_};
+    Shard& shard{*shards_[Route(value)]};
+    std::lock_guard<std::mutex> lock{shard.mutex_};
+
+    T const* old_data{shard.list_.insert(value)};
+    inserted = old_data == nullptr;
+    delete old_data;
+
+    if (inserted) {
+      shard.size_++;
+      width_++;
+    }
+    skewed = inserted && IsSkewed(shard);
+  }
+
+  if (skewed) Rebalance();
+  return inserted;
+}
+
+template <typename T>
+bool jhr::Sharded_Skip_List<T>::IsSkewed(Shard const& shard) const {
+  size_t threshold{std::max(2 * kMinShardSize_, 2 * width_ / kShardCount_)};
+  return shard.size_ > threshold;
+}
+
+// Merges `shards_[index + 1]` into `shards_[index]`.
+// Must be called with `router_mutex_` held exclusively.
+template <typename T>
+void jhr::Sharded_Skip_List<T>::Merge(size_t index) {
+  Shard& low{*shards_[index]};
+  Shard& high{*shards_[index + 1]};
+
+  low.list_.concat(high.list_);
+  low.size_ = low.list_.length();
+
+  shards_.erase(shards_.begin() + index + 1);
+  bounds_.erase(bounds_.begin() + index);
+}
+
+// Splits the largest shards and merges the smallest neighbours until no shard
+// is skewed and there are at most `kShardCount_` shards.
+template <typename T>
+void jhr::Sharded_Skip_List<T>::Rebalance() {
+  std::unique_lock<std::shared_mutex> router{router_mutex_};
+
+  // Every split is followed by at most one merge, this bounds the work done
+  // by a single rebalance.
+  for (size_t round = 0; round < kShardCount_; round++) {
+    auto largest = std::max_element(
+        shards_.begin(), shards_.end(),
+        [](auto const& a, auto const& b) { return a->size_ < b->size_; });
+    if (!IsSkewed(**largest)) break;
+
+    Split(static_cast<size_t>(largest - shards_.begin()));
+
+    if (shards_.size() > kShardCount_) {
+      size_t smallest{0};
+      for (size_t i = 1; i + 1 < shards_.size(); i++)
+        if (shards_[i]->size_ + shards_[i + 1]->size_ <
+            shards_[smallest]->size_ + shards_[smallest + 1]->size_)
+          smallest = i;
+      Merge(smallest);
+    }
+  }
+}
+
+// Removes the element equal to `value` from its shard.
+// Returns `true` if an element was removed.
+template <typename T>
+bool jhr::Sharded_Skip_List<T>::remove(T const& value) {
+  std::shared_lock<std::shared_mutex> router{router_mutex_};
+  Shard& shard{*shards_[Route(value)]};
+  std::lock_guard<std::mutex> lock{shard.mutex_};
+
+  T const* old_data{shard.list_.remove(value)};
+  if (old_data == nullptr) return false;
+  delete old_data;
+
+  shard.size_--;
+  width_--;
+  return true;
+}
+
+// Returns the index of the shard owning the key range of `value`.
+template <typename T>
+size_t jhr::Sharded_Skip_List<T>::Route(T const& value) const {
+  return static_cast<size_t>(
+      std::upper_bound(bounds_.begin(), bounds_.end(), value) -
+      bounds_.begin());
+}
+
+template <typename T>
+size_t jhr::Sharded_Skip_List<T>::shards() const {
+  std::shared_lock<std::shared_mutex> router{router_mutex_};
+  return shards_.size();
+}
+
+// Moves the upper half of `shards_[index]` to a new shard inserted right
+// after it. Must be called with `router_mutex_` held exclusively.
+template <typename T>
+void jhr::Sharded_Skip_List<T>::Split(size_t index) {
+  Shard& low{*shards_[index]};
+  size_t middle{low.list_.length() / 2};
+  if (middle == 0) return;
+
+  auto high = std::make_unique<Shard>();
+  T bound{low.list_.at(middle)};
+
+  Skip_List<T> upper{low.list_.split_at_index(middle)};
+  high->list_.concat(upper);
+
+  low.size_ = low.list_.length();
+  high->size_ = high->list_.length();
+
+  shards_.insert(shards_.begin() + index + 1, std::move(high));
+  bounds_.insert(bounds_.begin() + index, std::move(bound));
+}
+
+// Returns the `index`th element visible in the snapshot.
+// If `index` is greater than the number of visible elements throws an
+// `std::overflow_error`.
+template <typename T>
+T const& jhr::Versioned_Skip_List<T>::Snapshot::at(size_t index) const {
+  for (T const& value : *this)
+    if (index-- == 0) return value;
+  throw std::overflow_error("SKIP_LIST");
+}
+
+// The first entry is read and settled on under a single hold of the lock:
+// once released, `collect()` could unlink an entry the snapshot cannot see.
+template <typename T>
+typename jhr::Versioned_Skip_List<T>::Snapshot::iterator
+jhr::Versioned_Skip_List<T>::Snapshot::begin() const {
+  std::shared_lock<std::shared_mutex> lock{list_->mutex_};
+  return iterator{list_, sequence_, list_->list_.begin()};
+}
+
+// Returns the element equal to `value` as of the snapshot, or a null
+// pointer. The element stays valid as long as the snapshot lives.
+template <typename T>
+T const* jhr::Versioned_Skip_List<T>::Snapshot::find(T const& value) const {
+  std::shared_lock<std::shared_mutex> lock{list_->mutex_};
+  Entry const* entry{list_->list_.find(Entry{value})};
+  return entry ? Visible(*entry, sequence_) : nullptr;
+}
+
+// Drops every version no live snapshot can see and unlinks the elements
+// removed before the oldest live snapshot.
+template <typename T>
+void jhr::Versioned_Skip_List<T>::collect() {
+  std::unique_lock<std::shared_mutex> lock{mutex_};
+  uint64_t oldest{Oldest()};
+
+  std::vector<Entry const*> unlinked;
+  for (Entry const& entry : list_)
+    if (Trim(entry, oldest)) unlinked.push_back(&entry);
+
+  for (Entry const* entry : unlinked) delete list_.remove(*entry);
+}
+
+// Returns a copy of the latest version of the element equal to `value`.
+template <typename T>
+std::optional<T> jhr::Versioned_Skip_List<T>::find(T const& value) const {
+  std::shared_lock<std::shared_mutex> lock{mutex_};
+  Entry const* entry{list_.find(Entry{value})};
+  T const* data{entry ? Visible(*entry, sequence_) : nullptr};
+  if (data == nullptr) return std::nullopt;
+  return *data;
+}
+
+// Inserts a new version of `value`, tagged with the next sequence number.
+// Returns `true` if the element was not in the latest version of the list.
+template <typename T>
+bool jhr::Versioned_Skip_List<T>::insert(T const& value) {
+  std::unique_lock<std::shared_mutex> lock{mutex_};
+
+  Entry probe{value};
+  Entry const* entry{list_.find(probe)};
+  if (entry == nullptr) {
+    list_.insert(probe);
+    entry = list_.find(probe);
+  }
+
+  bool inserted{!Visible(*entry, sequence_)};
+  entry->newest_ = std::make_unique<Version>(
+      Version{++sequence_, std::make_unique<T const>(value),
+              std::move(entry->newest_)});
+  Trim(*entry, Oldest());
+
+  if (inserted) width_++;
+  return inserted;
+}
+
+template <typename T>
+size_t jhr::Versioned_Skip_List<T>::length() const {
+  std::shared_lock<std::shared_mutex> lock{mutex_};
+  return width_;
+}
+
+// Returns the sequence number of the oldest live snapshot, or of the last
+// write if there is none.
+// Must be called with `mutex_` held.
+template <typename T>
+uint64_t jhr::Versioned_Skip_List<T>::Oldest() const {
+  std::lock_guard<std::mutex> lock{snapshots_mutex_};
+  return snapshots_.empty() ? sequence_ : *snapshots_.begin();
+}
+
+template <typename T>
+void jhr::Versioned_Skip_List<T>::Release(uint64_t sequence) const {
+  std::lock_guard<std::mutex> lock{snapshots_mutex_};
+  snapshots_.erase(snapshots_.find(sequence));
+}
+
+// Adds a removal version to the element equal to `value`.
+// Returns `true` if the element was in the latest version of the list.
+template <typename T>
+bool jhr::Versioned_Skip_List<T>::remove(T const& value) {
+  std::unique_lock<std::shared_mutex> lock{mutex_};
+
+  Entry const* entry{list_.find(Entry{value})};
+  if (entry == nullptr || !Visible(*entry, sequence_)) return false;
+
+  entry->newest_ = std::make_unique<Version>(
+      Version{++sequence_, nullptr, std::move(entry->newest_)});
+  if (Trim(*entry, Oldest())) delete list_.remove(*entry);
+
+  width_--;
+  return true;
+}
+
+template <typename T>
+uint64_t jhr::Versioned_Skip_List<T>::sequence() const {
+  std::shared_lock<std::shared_mutex> lock{mutex_};
+  return sequence_;
+}
+
+// Takes a snapshot of the list as of the last write.
+template <typename T>
+typename jhr::Versioned_Skip_List<T>::Snapshot
+jhr::Versioned_Skip_List<T>::snapshot() const {
+  std::shared_lock<std::shared_mutex> lock{mutex_};
+  std::lock_guard<std::mutex> snapshots_lock{snapshots_mutex_};
+  snapshots_.insert(sequence_);
+  return Snapshot{this, sequence_};
+}
+
+// Keeps the versions newer than `oldest` and the newest version `oldest` can
+// see, the older ones are hidden behind it for every live snapshot.
+// Returns `true` if the only version left is a removal, the entry is then
+// visible to no snapshot.
+template <typename T>
+bool jhr::Versioned_Skip_List<T>::Trim(Entry const& entry, uint64_t oldest) {
+  Version* v{entry.newest_.get()};
+  while (v && v->sequence_ > oldest) v = v->older_.get();
+  if (v == nullptr) return false;
+
+  v->older_.reset();
+  return v == entry.newest_.get() && v->data_ == nullptr;
+}
+
+// Returns the data of the newest version of `entry` written up to
+// `sequence`, or a null pointer if it did not exist.
+template <typename T>
+T const* jhr::Versioned_Skip_List<T>::Visible(Entry const& entry,
+                                               uint64_t sequence) {
+  Version const* v{entry.newest_.get()};
+  while (v && v->sequence_ > sequence) v = v->older_.get();
+  return v ? v->data_.get() : nullptr;
+}
+
+// Opens the run at `path` and reads its sparse index.
+// Throws an `std::runtime_error` if the file is not a run.
+template <typename T>
+jhr::Sorted_Run<T>::Sorted_Run(std::string const& path, Reader read)
+    : read_{ReaderOrDefault(std::move(read))},
+      in_{path, std::ios::binary} {
+  constexpr std::streamoff kFooter{4 * sizeof(uint64_t)};
+  in_.seekg(-kFooter, std::ios::end);
+  uint64_t index{internal::ReadPod<uint64_t>(in_)};
+  uint64_t blocks{internal::ReadPod<uint64_t>(in_)};
+  uint64_t width{internal::ReadPod<uint64_t>(in_)};
+  if (!in_ || internal::ReadPod<uint64_t>(in_) != kMagic_)
+    throw std::runtime_error("SKIP_LIST: not a sorted run " + path);
+
+  in_.seekg(static_cast<std::streamoff>(index));
+  index_.reserve(blocks);
+  for (uint64_t i = 0; i < blocks; i++) {
+    uint64_t offset{internal::ReadPod<uint64_t>(in_)};
+    uint32_t size{internal::ReadPod<uint32_t>(in_)};
+    index_.push_back(Block{offset, size, read_(in_)});
+  }
+  if (!in_) throw std::runtime_error("SKIP_LIST: truncated sorted run " + path);
+  width_ = width;
+}
+
+// Returns a copy of the element equal to `value`. The sparse index gives the
+// only block that can hold it, which is read and scanned.
+template <typename T>
+std::optional<T> jhr::Sorted_Run<T>::find(T const& value) const {
+  auto block = std::upper_bound(
+      index_.begin(), index_.end(), value,
+      [](T const& v, Block const& b) { return v < b.first; });
+  if (block == index_.begin()) return std::nullopt;
+  --block;
+
+  std::string bytes(block->size, '\0');
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    in_.clear();
+    in_.seekg(static_cast<std::streamoff>(block->offset));
+    in_.read(&bytes[0], static_cast<std::streamsize>(bytes.size()));
+    if (!in_) throw std::runtime_error("SKIP_LIST: truncated sorted run");
+  }
+
+  std::istringstream records{bytes};
+  uint32_t count{internal::ReadPod<uint32_t>(records)};
+  for (uint32_t i = 0; i < count; i++) {
+    T element{read_(records)};
+    if (element == value) return element;
+    if (value < element) break;
+  }
+  return std::nullopt;
+}
+
+template <typename T>
+typename jhr::Sorted_Run<T>::Reader jhr::Sorted_Run<T>::ReaderOrDefault(
+    Reader read) {
+  if (read) return read;
+  if constexpr (std::is_trivially_copyable<T>::value) {
+    return [](std::istream& in) { return internal::ReadPod<T>(in); };
+  } else {
+    throw std::invalid_argument("SKIP_LIST: T needs a reader");
+  }
+}
+
+// Writes the elements of `list` in order, in blocks of about `kBlockSize_`
+// bytes, then the sparse index and the footer.
+template <typename T>
+void jhr::Sorted_Run<T>::write(std::string const& path,
+                               Skip_List<T> const& list, Writer write) {
+  write = WriterOrDefault(std::move(write));
+
+  std::ofstream out{path, std::ios::binary | std::ios::trunc};
+  if (!out) throw std::runtime_error("SKIP_LIST: cannot open " + path);
+
+  std::vector<std::pair<uint64_t, uint32_t>> blocks;
+  std::vector<T const*> firsts;
+  uint64_t offset{0};
+
+  std::ostringstream block;
+  uint32_t count{0};
+  auto end_block = [&] {
+    if (count == 0) return;
+    std::string bytes{block.str()};
+    internal::WritePod(out, count);
+    out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+
+    uint32_t size{static_cast<uint32_t>(sizeof(count) + bytes.size())};
+    blocks.emplace_back(offset, size);
+    offset += size;
+    block.str("");
+    count = 0;
+  };
+
+  for (T const& value : list) {
+    if (count == 0) firsts.push_back(&value);
+    write(block, value);
+    count++;
+    if (static_cast<size_t>(block.tellp()) >= kBlockSize_) end_block();
+  }
+  end_block();
+
+  for (size_t i = 0; i < blocks.size(); i++) {
+    internal::WritePod(out, blocks[i].first);
+    internal::WritePod(out, blocks[i].second);
+    write(out, *firsts[i]);
+  }
+
+  internal::WritePod(out, offset);
+  internal::WritePod<uint64_t>(out, blocks.size());
+  internal::WritePod<uint64_t>(out, list.length());
+  internal::WritePod(out, kMagic_);
+
+  out.flush();
+  if (!out) throw std::runtime_error("SKIP_LIST: cannot write " + path);
+}
+
 template <typename T>
-inline std::string jhr::Skip_List<T>::CenterString(const std::string& s,
-                                                   size_t width) {
-  std::string r = std::string((width - 1) / 2 - s.length() / 2, ' ');
-  r = r + s;
-  r.resize(width, ' ');
-  return r;
-};
-// Draws a visual representation of the skip list.
-// A link to a node is represented by an arrow (`o-->`) and final elements of
-// a level, that point to a null pointer, are represented by an `x`.
+typename jhr::Sorted_Run<T>::Writer jhr::Sorted_Run<T>::WriterOrDefault(
+    Writer write) {
+  if (write) return write;
+  if constexpr (std::is_trivially_copyable<T>::value) {
+    return [](std::ostream& out, T const& value) {
+      internal::WritePod(out, value);
+    };
+  } else {
+    throw std::invalid_argument("SKIP_LIST: T needs a writer");
+  }
+}
+
 template <typename T>
-void jhr::Skip_List<T>::DisplayList() {
-  // Example result, heavily inspired by wikipedia's illustrations on skip
-  // lists
-  //            4
-  // o---------------------> x Level 2
-  //   1     1        2
-  // o---> o---> o---------> x Level 1
-  //   1     1     1     1     1     1
-  // o---> o---> o---> o---> o---> o---> Level 0
-  //       3     6     7     9     12
+jhr::Skip_Memtable<T>::Skip_Memtable(std::string const& prefix,
+                                     size_t threshold, Writer write,
+                                     Sizer size_of)
+    : prefix_{prefix},
+      kThreshold_{threshold},
+      write_{Sorted_Run<T>::WriterOrDefault(std::move(write))},
+      size_of_{std::move(size_of)} {
+  flusher_ = std::thread{[this] { Flush(); }};
+}
 
-  for (size_t i = level_; i > 0; i--) {
-    Skip_Node<T>* node = head_;
+template <typename T>
+jhr::Skip_Memtable<T>::~Skip_Memtable() {
+  {
+    std::unique_lock<std::shared_mutex> lock{mutex_};
+    stop_ = true;
+  }
+  pending_.notify_one();
+  flusher_.join();
+}
 
-    // Draws the width labels
-    while (node != nullptr) {
-      if (node->forward_[i - 1].width > 0)
-        std::cout << CenterString(std::to_string(node->forward_[i - 1].width),
-                                  node->forward_[i - 1].width * 6);
+// Returns a copy of the newest element equal to `value`.
+template <typename T>
+std::optional<T> jhr::Skip_Memtable<T>::find(T const& value) const {
+  std::shared_lock<std::shared_mutex> lock{mutex_};
 
-      node = node->forward_[i - 1].node;
-    }
+  T const* found{active_->find(value)};
+  for (size_t i = 0; found == nullptr && i < frozen_.size(); i++)
+    found = frozen_[i]->find(value);
 
-    std::cout << std::endl;
+  if (found == nullptr) return std::nullopt;
+  return *found;
+}
 
-    // Draws the arrows
-    node = head_;
-    while (node != nullptr) {
-      if (node->forward_[i - 1].width > 0)
-        std::cout << "o"
-                  << std::string(node->forward_[i - 1].width * 6 - 3, '-')
-                  << "> ";
-      else
-        std::cout << "x ";
-      node = node->forward_[i - 1].node;
+// Writes the oldest frozen list to a run without holding the lock, the list
+// being immutable, then drops it. Stops on the first error.
+template <typename T>
+void jhr::Skip_Memtable<T>::Flush() {
+  std::unique_lock<std::shared_mutex> lock{mutex_};
+
+  while (true) {
+    pending_.wait(lock, [this] { return stop_ || !frozen_.empty(); });
+    if (frozen_.empty()) return;
+
+    std::shared_ptr<Skip_List<T> const> list{frozen_.back()};
+    std::string path{prefix_ + std::to_string(runs_.size())};
+
+    lock.unlock();
+    std::exception_ptr error;
+    try {
+      Sorted_Run<T>::write(path, *list, write_);
+    } catch (...) {
+      error = std::current_exception();
     }
+    lock.lock();
 
-    std::cout << "Level " << i - 1 << std::endl;
+    if (error) {
+      error_ = error;
+      flushed_.notify_all();
+      return;
+    }
+    frozen_.pop_back();
+    runs_.push_back(std::move(path));
+    flushed_.notify_all();
   }
+}
 
-// Draws the node labels
-#if 0
-  Skip_Node<T>* node = head_;
-  while (node != nullptr) {
-    if (node->ptr_ != nullptr) {
-      std::cout << std::to_string(*node->ptr_)
-                << std::string(6 - std::to_string(*node->ptr_).length(), ' ');
+template <typename T>
+void jhr::Skip_Memtable<T>::freeze() {
+  std::unique_lock<std::shared_mutex> lock{mutex_};
+  if (error_) std::rethrow_exception(error_);
+  Rotate();
+}
+
+// Inserts `value` in the active list and freezes it once it uses more than
+// the threshold. A node is accounted for its element and an average tower.
+template <typename T>
+void jhr::Skip_Memtable<T>::insert(T const& value) {
+  std::unique_lock<std::shared_mutex> lock{mutex_};
+  if (error_) std::rethrow_exception(error_);
+
+  T const* old_data{active_->insert(value)};
+  if (old_data != nullptr) {
+    delete old_data;
+    return;
+  }
+
+  usage_ += Skip_Node<T>::Size(2) + sizeof(T);
+  if (size_of_) usage_ += size_of_(value);
+  if (usage_ >= kThreshold_) Rotate();
+}
+
+template <typename T>
+void jhr::Skip_Memtable<T>::Rotate() {
+  if (active_->empty()) return;
+
+  frozen_.push_front(std::move(active_));
+  active_ = std::make_unique<Skip_List<T>>();
+  usage_ = 0;
+  pending_.notify_one();
+}
+
+template <typename T>
+std::vector<std::string> jhr::Skip_Memtable<T>::runs() const {
+  std::shared_lock<std::shared_mutex> lock{mutex_};
+  return runs_;
+}
+
+template <typename T>
+size_t jhr::Skip_Memtable<T>::usage() const {
+  std::shared_lock<std::shared_mutex> lock{mutex_};
+  return usage_;
+}
+
+template <typename T>
+void jhr::Skip_Memtable<T>::wait() const {
+  std::shared_lock<std::shared_mutex> lock{mutex_};
+  flushed_.wait(lock, [this] { return frozen_.empty() || error_; });
+  if (error_) std::rethrow_exception(error_);
+}
+
+#ifdef JHR_SKIP_LIST_POSIX
+// Opens the list stored at `path`. With `Mode::kCreate` the file is created,
+// or truncated, and holds an empty list. Throws an `std::runtime_error` if the
+// file cannot be opened or does not hold a list of `T`.
+template <typename T>
+jhr::Mapped_Skip_List<T>::Mapped_Skip_List(std::string const& path, Mode mode,
+                                           size_t max_level, float p)
+    : read_only_{mode == Mode::kReadOnly} {
+  int flags{mode == Mode::kCreate ? O_RDWR | O_CREAT | O_TRUNC
+            : read_only_          ? O_RDONLY
+                                  : O_RDWR};
+  fd_ = ::open(path.c_str(), flags, 0644);
+  if (fd_ < 0) throw std::runtime_error("SKIP_LIST: cannot open " + path);
+
+  try {
+    if (mode == Mode::kCreate) {
+      if (max_level == 0 || max_level > kMaxLevels_)
+        throw std::runtime_error("SKIP_LIST: invalid maximum level");
+
+      // The head is the first node, right after the aligned header
+      uint64_t head{(sizeof(Header) + alignof(Node) - 1) / alignof(Node) *
+                    alignof(Node)};
+      Map(std::max<size_t>(1 << 16, 2 * (head + NodeSize(max_level))));
+
+      // The file is zero filled, links are already null
+      Header* h{header()};
+      std::memcpy(h->magic_, kMagic_, sizeof(kMagic_));
+      h->value_size_ = sizeof(T);
+      h->max_level_ = max_level;
+      h->p_ = p;
+      h->size_ = head + NodeSize(max_level);
+      h->width_ = 0;
+      h->level_ = 1;
+      h->head_ = head;
+      At(head)->level_ = max_level;
     } else {
-      std::cout << std::string(6, ' ');
+      struct stat st;
+      if (::fstat(fd_, &st) != 0 ||
+          static_cast<size_t>(st.st_size) < sizeof(Header))
+        throw std::runtime_error("SKIP_LIST: not a mapped skip list");
+      Map(static_cast<size_t>(st.st_size));
+
+      Header const* h{header()};
+      if (std::memcmp(h->magic_, kMagic_, sizeof(kMagic_)) != 0 ||
+          h->value_size_ != sizeof(T) || h->max_level_ == 0 ||
+          h->max_level_ > kMaxLevels_ || h->size_ > capacity_)
+        throw std::runtime_error("SKIP_LIST: not a mapped skip list of T");
     }
-    node = node->forward_[0].node;
+  } catch (...) {
+    if (base_) ::munmap(base_, capacity_);
+    ::close(fd_);
+    throw;
   }
-#endif
 }
 
-// Returns the node associated with `ptr` if it exist.
-// If `ptr` is not in the skip list it returns a null pointer.
 template <typename T>
-T const* jhr::Skip_List<T>::find(T const& ptr) {
-  jhr::Skip_Node<T>* x{head_};
+jhr::Mapped_Skip_List<T>::~Mapped_Skip_List() {
+  if (base_) ::munmap(base_, capacity_);
+  if (fd_ >= 0) ::close(fd_);
+}
+
+// Returns the offset of a new node with `level` links, taken from the free
+// list of its height or carved at the end of the file. The file is doubled
+// when it is full.
+template <typename T>
+uint64_t jhr::Mapped_Skip_List<T>::Allocate(size_t level) {
+  Header* h{header()};
+  uint64_t offset{h->free_[level - 1]};
 
-  for (size_t i = level_; i > 0; i--) {
-    while (x->forward_[i - 1].node != nullptr &&
-           *(x->forward_[i - 1].node->ptr_) < ptr) {
-      x = x->forward_[i - 1].node;
+  if (offset) {
+    h->free_[level - 1] = At(offset)->forward_[0].node;
+  } else {
+    size_t size{NodeSize(level)};
+    if (h->size_ + size > capacity_) {
+      Map(std::max(2 * capacity_, h->size_ + size));
+      h = header();
     }
+    offset = h->size_;
+    h->size_ += size;
   }
-  x = x->forward_[0].node;
-  if (*(x->ptr_) == ptr) return x->ptr_;
 
-  return nullptr;
-};
+  Node* node{At(offset)};
+  node->level_ = level;
+  for (size_t i = 0; i < level; i++) node->forward_[i] = Mapped_Link{};
+  return offset;
+}
 
-// Inserts a new element in the skip list returns a pointer to the newly
-// created node. If the element was already in the skip list, updates the data
-// and returns the previously stored data
+// Returns the `index`th element of the skip list.
+// If `index` is greater than the width of the skip list throws an
+// `std::overflow_error`.
 template <typename T>
-T const* jhr::Skip_List<T>::insert(T const& ptr) {
-  // Array of pointers to elements that will need updating
-  std::unique_ptr<Skip_Node<T>* []> update {
-    new Skip_Node<T>* [kMaxLevel_] {}
-  };
+T const& jhr::Mapped_Skip_List<T>::at(size_t index) const {
+  if (index >= length()) throw std::overflow_error("SKIP_LIST");
 
-  std::unique_ptr<size_t[]> update_width{new size_t[kMaxLevel_]{}};
-
-  Skip_Node<T>* x{head_};
+  size_t w{index + 1};
 
-  for (size_t i = level_; i > 0; i--) {
-    // The sum of traveled widths
-    size_t width_sum{0};
+  Node const* x{At(header()->head_)};
 
-    while (x->forward_[i - 1].node != nullptr &&
-           *(x->forward_[i - 1].node->ptr_) < ptr) {
-      width_sum += x->forward_[i - 1].width;
-      x = x->forward_[i - 1].node;
+  for (size_t i = header()->level_; i > 0; i--) {
+    while (x->forward_[i - 1].node != 0 && x->forward_[i - 1].width <= w) {
+      w -= x->forward_[i - 1].width;
+      x = At(x->forward_[i - 1].node);
+      if (w == 0) return x->value_;
     }
+  }
+  throw std::overflow_error("SKIP_LIST");
+}
 
-    update[i - 1] = x;
-    update_width[i - 1] = width_sum;
+// Returns the element equal to `value` if it exist, or a null pointer.
+template <typename T>
+T const* jhr::Mapped_Skip_List<T>::find(T const& value) const {
+  Node const* x{At(header()->head_)};
+
+  for (size_t i = header()->level_; i > 0; i--) {
+    while (x->forward_[i - 1].node != 0 &&
+           At(x->forward_[i - 1].node)->value_ < value) {
+      x = At(x->forward_[i - 1].node);
+    }
   }
+  x = At(x->forward_[0].node);
+  if (x != nullptr && x->value_ == value) return &x->value_;
 
-  size_t level{RandomLevel()};
+  return nullptr;
+}
 
-  // Complete the update list with the head of the list
-  // if the new node is the first node on a new levels
-  if (level > level_) {
-    for (size_t i = level_; i < level; i++) {
-      update[i] = head_;
+template <typename T>
+void jhr::Mapped_Skip_List<T>::flush() {
+  if (::msync(base_, capacity_, MS_SYNC) != 0)
+    throw std::runtime_error("SKIP_LIST: cannot flush the mapped file");
+}
 
-      // For simplicity, the width to nullptr is always 0
-      head_->forward_[i].width = 0;
+// Inserts `value` in the skip list. If an equal element is already in the
+// list it is overwritten in place.
+// The search path is kept as offsets since allocating the node can remap the
+// file.
+template <typename T>
+bool jhr::Mapped_Skip_List<T>::insert(T const& value) {
+  if (read_only_) throw std::logic_error("SKIP_LIST: read-only list");
+
+  uint64_t update[kMaxLevels_];
+  size_t update_rank[kMaxLevels_];
+
+  Header* h{header()};
+  uint64_t x{h->head_};
+  size_t rank{0};
+
+  for (size_t i = h->level_; i > 0; i--) {
+    Node const* node{At(x)};
+    while (node->forward_[i - 1].node != 0 &&
+           At(node->forward_[i - 1].node)->value_ < value) {
+      rank += node->forward_[i - 1].width;
+      x = node->forward_[i - 1].node;
+      node = At(x);
     }
-    level_ = level;
+    update[i - 1] = x;
+    update_rank[i - 1] = rank;
   }
 
-  // If the node is already in the list retuns the already existing node
-  if (x->forward_[0].node != nullptr)
-    if (*(x->forward_[0].node->ptr_) == ptr) {
-      T const* old_data = x->forward_[0].node->ptr_;
-      x->forward_[0].node->ptr_ = new T{ptr};
-      return old_data;
-    }
+  Node* next{At(At(x)->forward_[0].node)};
+  if (next != nullptr && next->value_ == value) {
+    next->value_ = value;
+    return false;
+  }
 
-  Skip_Node<T>* new_node = CreateNode(new T{ptr}, level);
+  size_t level{RandomLevel()};
+  for (size_t i = h->level_; i < level; i++) {
+    update[i] = h->head_;
+    update_rank[i] = 0;
+  }
 
-  for (size_t i = 0; i < level; i++) {
-    // Update the linked nodes
-    new_node->forward_[i].node = update[i]->forward_[i].node;
-    update[i]->forward_[i].node = new_node;
+  uint64_t offset{Allocate(level)};
+  h = header();
+  Node* node{At(offset)};
+  node->value_ = value;
 
-    // updates the widths of the links
-    if (i > 0) {
-      size_t width_before{update_width[i - 1] +
-                          update[i - 1]->forward_[i - 1].width};
-
-      if (update[i]->forward_[i].width > 0)
-        // The width is the width of the previous connection,
-        // + 1 ( because we are inserting a node )
-        // - whatever is before the new node
-        new_node->forward_[i].width =
-            update[i]->forward_[i].width + 1 - width_before;
-      else
-        // For simplicity, the width to nullptr is always 0
-        new_node->forward_[i].width = 0;
+  // Rank of the new node
+  size_t r{update_rank[0] + 1};
 
-      update[i]->forward_[i].width = width_before;
-    }
+  for (size_t i = 0; i < level; i++) {
+    Node* u{At(update[i])};
+    Mapped_Link old{u->forward_[i]};
+    if (old.node != 0)
+      node->forward_[i] = {update_rank[i] + old.width + 1 - r, old.node};
+    u->forward_[i] = {r - update_rank[i], offset};
   }
 
-  /* Updates the widths of the links above the newly created node. */
-  for (size_t i = level; i < level_; ++i) {
-    if (update[i]->forward_[i].node)
-      ++update[i]->forward_[i].width;
-    else
-      /* The width to NULL is always 0 and does not need updating. All links
-       * above a link pointing to NULL will point to NULL. */
-      break;
+  // Links above the new node now span one more node
+  for (size_t i = level; i < h->level_; i++) {
+    Node* u{At(update[i])};
+    if (u->forward_[i].node != 0) u->forward_[i].width++;
   }
 
-  width_++;
+  h->level_ = std::max<uint64_t>(h->level_, level);
+  h->width_++;
+  return true;
+}
 
-  return nullptr;
+// Maps the first `capacity` bytes of the file, growing it if needed.
+template <typename T>
+void jhr::Mapped_Skip_List<T>::Map(size_t capacity) {
+  if (base_) {
+    ::munmap(base_, capacity_);
+    base_ = nullptr;
+  }
+  if (!read_only_ && ::ftruncate(fd_, static_cast<off_t>(capacity)) != 0)
+    throw std::runtime_error("SKIP_LIST: cannot grow the mapped file");
+
+  int protection{read_only_ ? PROT_READ : PROT_READ | PROT_WRITE};
+  void* base{::mmap(nullptr, capacity, protection, MAP_SHARED, fd_, 0)};
+  if (base == MAP_FAILED)
+    throw std::runtime_error("SKIP_LIST: cannot map the file");
+
+  base_ = static_cast<char*>(base);
+  capacity_ = capacity;
 }
 
-// Returns the optimal max level based on the probability `p` to add a new
-// level and the estimated maximum number of elements `N`
-// If `p` is invalid (p > 1 || p < 0) returns 0
 template <typename T>
-inline size_t jhr::Skip_List<T>::MaxLevel(
-    size_t N /*maximum number of elements*/, float p) {
-  if (!(0.0F <= p <= 1.0F)) return 0;
-  return static_cast<size_t>(log(N) / log(1 / p));
+size_t jhr::Mapped_Skip_List<T>::NodeSize(size_t level) {
+  size_t size{sizeof(Node) + (level - 1) * sizeof(Mapped_Link)};
+  return (size + alignof(Node) - 1) / alignof(Node) * alignof(Node);
 }
 
 template <typename T>
-size_t jhr::Skip_List<T>::RandomLevel() {
-  float rnd{std::rand() / static_cast<float>(RAND_MAX)};
+size_t jhr::Mapped_Skip_List<T>::RandomLevel() {
+  std::uniform_real_distribution<float> distribution{0.0f, 1.0f};
+  size_t max_level{header()->max_level_};
   size_t level{1};
-  while (rnd < p_ && level < kMaxLevel_ - 1) {
-    level++;
-    rnd = std::rand() / static_cast<float>(RAND_MAX);
-  }
+  while (distribution(random_) < header()->p_ && level < max_level - 1) level++;
   return level;
 }
 
-// Removes an element from the skip list and returns a boolean if the
-// operation was successful
+// Removes the element equal to `value` and puts its node on the free list of
+// its height.
 template <typename T>
-T const* jhr::Skip_List<T>::remove(T const& ptr) {
-  std::unique_ptr<Skip_Node<T>* []> update {
-    new jhr::Skip_Node<T>* [level_] {}
-  };
+bool jhr::Mapped_Skip_List<T>::remove(T const& value) {
+  if (read_only_) throw std::logic_error("SKIP_LIST: read-only list");
 
-  Skip_Node<T>* x{head_};
+  Node* update[kMaxLevels_];
 
-  for (size_t i = level_; i > 0; i--) {
-    while (x->forward_[i - 1].node != nullptr &&
-           *(x->forward_[i - 1].node->ptr_) < ptr) {
-      x = x->forward_[i - 1].node;
+  Header* h{header()};
+  Node* x{At(h->head_)};
+
+  for (size_t i = h->level_; i > 0; i--) {
+    while (x->forward_[i - 1].node != 0 &&
+           At(x->forward_[i - 1].node)->value_ < value) {
+      x = At(x->forward_[i - 1].node);
     }
     update[i - 1] = x;
   }
 
-  x = x->forward_[0].node;
+  uint64_t offset{x->forward_[0].node};
+  x = At(offset);
+  if (x == nullptr || !(x->value_ == value)) return false;
 
-  // Could not find `*ptr` in the skip list
-  if (x == nullptr) return nullptr;
-  if (!(*(x->ptr_) == ptr)) return nullptr;
+  for (size_t i = 0; i < h->level_; i++) {
+    Mapped_Link& link{update[i]->forward_[i]};
+    if (link.node == offset) {
+      Mapped_Link next{x->forward_[i]};
+      link = {next.node != 0 ? link.width + next.width - 1 : 0, next.node};
+    } else if (link.node != 0) {
+      link.width--;
+    }
+  }
 
-  for (size_t i = 0; i < level_; i++) {
-    if (update[i]->forward_[i].node != x) {
-      update[i]->forward_[i].width--;
-    } else {
-      update[i]->forward_[i].node = x->forward_[i].node;
+  x->forward_[0].node = h->free_[x->level_ - 1];
+  h->free_[x->level_ - 1] = offset;
+  h->width_--;
 
-      if (x->forward_[i].width > 0)
-        update[i]->forward_[i].width += x->forward_[i].width - 1;
-      else
-        update[i]->forward_[i].width = 0;
+  // Updates the list's max level
+  Node const* head{At(h->head_)};
+  while (h->level_ > 1 && head->forward_[h->level_ - 1].node == 0) h->level_--;
+
+  return true;
+}
+#endif  // JHR_SKIP_LIST_POSIX
+
+#ifdef JHR_SKIP_LIST_POSIX
+inline jhr::Write_Ahead_Log::Write_Ahead_Log(
+    std::string const& path, std::chrono::milliseconds interval)
+    : interval_{interval} {
+  fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+  if (fd_ < 0) throw std::runtime_error("SKIP_LIST: cannot open " + path);
+  flusher_ = std::thread{[this] { Flush(); }};
+}
+
+inline jhr::Write_Ahead_Log::~Write_Ahead_Log() {
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    stop_ = true;
+  }
+  pending_.notify_one();
+  flusher_.join();
+  ::close(fd_);
+}
+
+// Appends a record made of its payload size, its checksum, its type and its
+// payload to the pending buffer.
+inline uint64_t jhr::Write_Ahead_Log::append(uint8_t type,
+                                             char const* data, size_t size) {
+  if (size > UINT32_MAX)
+    throw std::invalid_argument("SKIP_LIST: record is too large");
+  uint32_t length{static_cast<uint32_t>(size)};
+  uint32_t checksum{Checksum(type, data, size)};
+
+  std::lock_guard<std::mutex> lock{mutex_};
+  buffer_.append(reinterpret_cast<char const*>(&length), sizeof(length));
+  buffer_.append(reinterpret_cast<char const*>(&checksum), sizeof(checksum));
+  buffer_.push_back(static_cast<char>(type));
+  buffer_.append(data, size);
+
+  if (buffer_.size() >= kMaxBatch_) pending_.notify_one();
+  return ++appended_;
+}
+
+// 32 bit FNV-1a of the type and the payload of a record.
+inline uint32_t jhr::Write_Ahead_Log::Checksum(uint8_t type,
+                                               char const* data, size_t size) {
+  uint32_t checksum{2166136261U};
+  checksum = (checksum ^ type) * 16777619U;
+  for (size_t i = 0; i < size; i++)
+    checksum = (checksum ^ static_cast<unsigned char>(data[i])) * 16777619U;
+  return checksum;
+}
+
+// Wakes up every `interval_`, or once enough bytes are pending or a thread
+// waits for pending records, takes the whole pending buffer, writes it and
+// syncs the file once for all of its records. Records appended meanwhile go
+// to the next batch. A write interrupted by a signal is retried, any other
+// failure is final.
+inline void jhr::Write_Ahead_Log::Flush() {
+  std::unique_lock<std::mutex> lock{mutex_};
+  std::string batch;
+
+  while (true) {
+    pending_.wait_for(lock, interval_, [this] {
+      return stop_ || buffer_.size() >= kMaxBatch_ ||
+             (waiting_ > 0 && !buffer_.empty());
+    });
+    if (buffer_.empty()) {
+      if (stop_) return;
+      continue;
+    }
+
+    batch.swap(buffer_);
+    uint64_t last{appended_};
+    writing_ = true;
+
+    lock.unlock();
+    bool written{true};
+    for (size_t done = 0; done < batch.size();) {
+      ssize_t n{::write(fd_, batch.data() + done, batch.size() - done)};
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        written = false;
+        break;
+      }
+      done += static_cast<size_t>(n);
     }
+#ifdef __APPLE__
+    written = written && ::fsync(fd_) == 0;
+#else
+    written = written && ::fdatasync(fd_) == 0;
+#endif
+    batch.clear();
+    lock.lock();
+    writing_ = false;
+
+    if (written)
+      synced_ = std::max(synced_, last);
+    else
+      failed_ = true;
+    durable_.notify_all();
   }
+}
 
-  T const* old_data = x->ptr_;
-  delete x;
+// Replays the intact records of the log at `path`. The first record that is
+// truncated or does not match its checksum marks the end of the log, it and
+// everything after it is cut off.
+inline void jhr::Write_Ahead_Log::replay(
+    std::string const& path,
+    std::function<void(uint8_t, char const*, size_t)> const& apply) {
+  int fd{::open(path.c_str(), O_RDWR)};
+  if (fd < 0) return;
 
-  // Updates the list's max level
-  while (level_ > 1 && head_->forward_[level_ - 1].node == nullptr) level_--;
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    ::close(fd);
+    throw std::runtime_error("SKIP_LIST: cannot read " + path);
+  }
 
-  return old_data;
-};
+  std::string log(static_cast<size_t>(st.st_size), '\0');
+  for (size_t done = 0; done < log.size();) {
+    ssize_t n{::pread(fd, &log[done], log.size() - done,
+                      static_cast<off_t>(done))};
+    if (n <= 0) {
+      log.resize(done);
+      break;
+    }
+    done += static_cast<size_t>(n);
+  }
+
+  constexpr size_t kHeader{2 * sizeof(uint32_t) + 1};
+  size_t offset{0};
+  while (offset + kHeader <= log.size()) {
+    uint32_t length;
+    uint32_t checksum;
+    std::memcpy(&length, &log[offset], sizeof(length));
+    std::memcpy(&checksum, &log[offset + sizeof(length)], sizeof(checksum));
+    uint8_t type{static_cast<uint8_t>(log[offset + 2 * sizeof(uint32_t)])};
+    char const* data{log.data() + offset + kHeader};
+
+    if (length > log.size() - offset - kHeader ||
+        Checksum(type, data, length) != checksum)
+      break;
+
+    apply(type, data, length);
+    offset += kHeader + length;
+  }
+
+  if (offset < log.size())
+    if (::ftruncate(fd, static_cast<off_t>(offset)) != 0) {
+      ::close(fd);
+      throw std::runtime_error("SKIP_LIST: cannot truncate " + path);
+    }
+  ::close(fd);
+}
+
+inline void jhr::Write_Ahead_Log::sync() {
+  uint64_t last;
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    last = appended_;
+  }
+  wait(last);
+}
+
+// Empties the log. Pending records are dropped and count as durable.
+// Waits for a batch being written so that it does not end up, or get torn,
+// after the truncation.
+inline void jhr::Write_Ahead_Log::truncate() {
+  std::unique_lock<std::mutex> lock{mutex_};
+  durable_.wait(lock, [this] { return !writing_; });
+  buffer_.clear();
+  if (::ftruncate(fd_, 0) != 0)
+    throw std::runtime_error("SKIP_LIST: cannot truncate the log");
+  synced_ = appended_;
+  durable_.notify_all();
+}
+
+inline void jhr::Write_Ahead_Log::wait(uint64_t sequence) {
+  std::unique_lock<std::mutex> lock{mutex_};
+  waiting_++;
+  pending_.notify_one();
+  durable_.wait(lock, [this, sequence] {
+    return failed_ || synced_ >= sequence;
+  });
+  waiting_--;
+  if (synced_ < sequence)
+    throw std::runtime_error("SKIP_LIST: cannot write the log");
+}
+
+// Opens the durable list: loads the snapshot at `snapshot_path` if there is
+// one, replays the log at `log_path` over it and opens the log for writing.
+template <typename T>
+jhr::Durable_Skip_List<T>::Durable_Skip_List(std::string const& snapshot_path,
+                                             std::string const& log_path,
+                                             std::chrono::milliseconds interval,
+                                             bool synchronous)
+    : snapshot_path_{snapshot_path}, synchronous_{synchronous} {
+  if (std::ifstream{snapshot_path, std::ios::binary}) list_.load(snapshot_path);
+
+  Write_Ahead_Log::replay(
+      log_path, [this](uint8_t type, char const* data, size_t size) {
+        if (size != sizeof(T)) return;
+        T value;
+        std::memcpy(&value, data, sizeof(T));
+        if (type == kInsert) delete list_.insert(value);
+        if (type == kRemove) delete list_.remove(value);
+      });
+
+  log_ = std::make_unique<Write_Ahead_Log>(log_path, interval);
+}
+
+template <typename T>
+T jhr::Durable_Skip_List<T>::at(size_t index) const {
+  std::lock_guard<std::mutex> lock{mutex_};
+  return list_.at(index);
+}
+
+// Saves a snapshot of the list next to the previous one, syncs it, replaces
+// the previous one with it and syncs their directory so that the rename is
+// durable, then empties the log. A crash before the log is emptied replays
+// it over the new snapshot, which writes the same values.
+template <typename T>
+void jhr::Durable_Skip_List<T>::checkpoint() {
+  std::lock_guard<std::mutex> lock{mutex_};
+
+  std::string temporary{snapshot_path_ + ".tmp"};
+  list_.save(temporary);
+
+  int fd{::open(temporary.c_str(), O_RDONLY)};
+  bool synced{fd >= 0 && ::fsync(fd) == 0};
+  if (fd >= 0) ::close(fd);
+  if (!synced || std::rename(temporary.c_str(), snapshot_path_.c_str()) != 0)
+    throw std::runtime_error("SKIP_LIST: cannot write " + snapshot_path_);
+
+  size_t slash{snapshot_path_.rfind('/')};
+  std::string directory{slash == std::string::npos ? "."
+                        : slash == 0               ? "/"
+                                 : snapshot_path_.substr(0, slash)};
+  fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+  synced = fd >= 0 && ::fsync(fd) == 0;
+  if (fd >= 0) ::close(fd);
+  if (!synced)
+    throw std::runtime_error("SKIP_LIST: cannot sync " + directory);
+
+  log_->truncate();
+}
+
+template <typename T>
+std::optional<T> jhr::Durable_Skip_List<T>::find(T const& value) const {
+  std::lock_guard<std::mutex> lock{mutex_};
+  T const* found{list_.find(value)};
+  if (found == nullptr) return std::nullopt;
+  return *found;
+}
+
+// Logs then inserts `value`. The lock is released before waiting for the
+// record to be durable so that other writers join the same group commit.
+template <typename T>
+bool jhr::Durable_Skip_List<T>::insert(T const& value) {
+  uint64_t sequence;
+  bool inserted;
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    sequence = log_->append(kInsert, reinterpret_cast<char const*>(&value),
+                            sizeof(T));
+    T const* old_data{list_.insert(value)};
+    inserted = old_data == nullptr;
+    delete old_data;
+  }
+
+  if (synchronous_) log_->wait(sequence);
+  return inserted;
+}
+
+template <typename T>
+size_t jhr::Durable_Skip_List<T>::length() const {
+  std::lock_guard<std::mutex> lock{mutex_};
+  return list_.length();
+}
+
+// Logs then removes the element equal to `value`. Nothing is logged if
+// there is no such element.
+template <typename T>
+bool jhr::Durable_Skip_List<T>::remove(T const& value) {
+  uint64_t sequence;
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    if (list_.find(value) == nullptr) return false;
+
+    sequence = log_->append(kRemove, reinterpret_cast<char const*>(&value),
+                            sizeof(T));
+    delete list_.remove(value);
+  }
+
+  if (synchronous_) log_->wait(sequence);
+  return true;
+}
+#endif  // JHR_SKIP_LIST_POSIX
 
 #endif
 